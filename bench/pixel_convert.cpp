@@ -0,0 +1,115 @@
+// Micro-benchmark for the CGUITTFont glyph bitmap conversion kernels.
+// Converts a page worth of synthetic glyph rows with the original per-pixel loops and with every
+// kernel set the CPU supports, checks the kernels agree, and prints the time each one took.
+// Usage: pixel_convert.out [iterations]
+#include <irrlicht.h>
+#include "font/CGUITTFont/CGUITTPixelConverter.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace irr;
+using namespace irr::gui;
+
+namespace
+{
+	// Rows of a 4096 wide page, the size used for CJK fonts.
+	const u32 ROW_WIDTH = 4096;
+	const u32 ROW_COUNT = 64;
+
+	// The loops CGUITTFont used before the kernels, kept here to compare against.
+	void reference_gray(u32* dest, const u8* src, u32 count)
+	{
+		const float gray_count = 256.f;
+		for (u32 x = 0; x < count; ++x)
+		{
+			dest[x] = 0x00FFFFFF;
+			dest[x] |= static_cast<u32>(255.0f * (static_cast<float>(src[x]) / gray_count)) << 24;
+		}
+	}
+
+	void reference_mono(u16* dest, const u8* src, u32 count)
+	{
+		for (u32 x = 0; x < count; ++x)
+		{
+			dest[x] = 0x7FFF;
+			if ((src[x / 8] & (0x80 >> (x % 8))) != 0)
+				dest[x] = 0xFFFF;
+		}
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsed_ms(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	template <class T, class F>
+	double time_rows(F convert, std::vector<T>& dest, const std::vector<u8>& src, u32 src_pitch, u32 iterations)
+	{
+		const Clock::time_point start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			for (u32 y = 0; y < ROW_COUNT; ++y)
+				convert(&dest[y * ROW_WIDTH], &src[y * src_pitch], ROW_WIDTH);
+		return elapsed_ms(start);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const u32 iterations = argc > 1 ? (u32)atoi(argv[1]) : 200;
+	const u32 mono_pitch = ROW_WIDTH / 8;
+
+	// Something glyph-like: long runs of empty and full coverage with edges in between.
+	std::vector<u8> gray(ROW_WIDTH * ROW_COUNT);
+	std::vector<u8> mono(mono_pitch * ROW_COUNT);
+	srand(1);
+	for (u32 i = 0; i < gray.size(); ++i)
+	{
+		const u32 r = rand() % 4;
+		gray[i] = r == 0 ? 0 : (r == 1 ? 255 : (u8)(rand() & 0xFF));
+	}
+	for (u32 i = 0; i < mono.size(); ++i)
+		mono[i] = (u8)(rand() & 0xFF);
+
+	std::vector<u32> argb(ROW_WIDTH * ROW_COUNT), argb_check(ROW_WIDTH * ROW_COUNT);
+	std::vector<u16> a1r5g5b5(ROW_WIDTH * ROW_COUNT), a1r5g5b5_check(ROW_WIDTH * ROW_COUNT);
+	std::vector<u8> r8(ROW_WIDTH * ROW_COUNT), r8_check(ROW_WIDTH * ROW_COUNT);
+
+	printf("%u rows of %u pixels, %u iterations\n", ROW_COUNT, ROW_WIDTH, iterations);
+	printf("%-10s %12s %12s %12s\n", "kernel", "gray ms", "mono ms", "mono r8 ms");
+	printf("%-10s %12.3f %12.3f %12s\n", "reference",
+		time_rows(reference_gray, argb, gray, ROW_WIDTH, iterations),
+		time_rows(reference_mono, a1r5g5b5, mono, mono_pitch, iterations), "-");
+
+	// The scalar kernels are the reference for checking the others.
+	const SGUITTPixelConverter& scalar = SGUITTPixelConverter::get(EGPK_SCALAR);
+	time_rows(scalar.grayToA8R8G8B8, argb_check, gray, ROW_WIDTH, 1);
+	time_rows(scalar.monoToA1R5G5B5, a1r5g5b5_check, mono, mono_pitch, 1);
+	time_rows(scalar.monoToR8, r8_check, mono, mono_pitch, 1);
+
+	int result = 0;
+	for (u32 k = 0; k < EGPK_COUNT; ++k)
+	{
+		if (!SGUITTPixelConverter::isSupported((E_GUITT_PIXEL_KERNEL)k))
+			continue;
+
+		const SGUITTPixelConverter& convert = SGUITTPixelConverter::get((E_GUITT_PIXEL_KERNEL)k);
+		const double gray_ms = time_rows(convert.grayToA8R8G8B8, argb, gray, ROW_WIDTH, iterations);
+		const double mono_ms = time_rows(convert.monoToA1R5G5B5, a1r5g5b5, mono, mono_pitch, iterations);
+		const double r8_ms = time_rows(convert.monoToR8, r8, mono, mono_pitch, iterations);
+		printf("%-10s %12.3f %12.3f %12.3f\n", convert.name, gray_ms, mono_ms, r8_ms);
+
+		if (argb != argb_check || a1r5g5b5 != a1r5g5b5_check || r8 != r8_check)
+		{
+			printf("  %s output differs from the scalar kernels\n", convert.name);
+			result = 1;
+		}
+	}
+
+	printf("selected: %s\n", SGUITTPixelConverter::get().name);
+	return result;
+}
@@ -0,0 +1,407 @@
+// Text rendering benchmark for CGUITTFont.
+// Loads a font on a headless Irrlicht device and times font loading, glyph preloading, measuring,
+// hit-testing and drawing of ASCII, Latin-1 and CJK text, then writes the results as JSON so runs
+// can be compared release to release.
+// Usage: text_render.out font.ttf [options]
+//   --cjk-font file       Font for the CJK text.  Default: the first font.
+//   --driver null|burnings
+//                         Default: null, which draws nothing, so draw() times are layout and batching only.
+//                         Burnings' Video rasterizes for real but opens a window, so it needs a display
+//                         (xvfb-run works).
+//   --size pixels         Default: 16.
+//   --iterations n        Default: 200.
+//   --threads n           Glyph rasterizer threads.  Default: 0.
+//   --out file            Write the JSON to a file instead of stdout.
+// The allocations made inside draw() once the pages and layout buffers are warm are counted too.
+// With the null driver they must be zero, or the run fails.
+#include <irrlicht.h>
+#include "font/CGUITTFont/CGUITTFont.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Counts the allocations made while counting is switched on.  Irrlicht's arrays and strings
+// allocate through operator new, so this sees every allocation the font makes.
+static std::atomic<bool> count_allocations(false);
+static std::atomic<unsigned> allocation_count(0);
+
+void* operator new(std::size_t size)
+{
+	if (count_allocations)
+		++allocation_count;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+using namespace irr;
+using namespace irr::gui;
+
+namespace
+{
+	const u32 SCREEN_WIDTH = 640;
+	const u32 SCREEN_HEIGHT = 480;
+	const u32 LINE_COUNT = 40;
+	const u32 CJK_LINE_LENGTH = 40;
+	const u32 FONT_LOADS = 5;
+
+	typedef std::chrono::steady_clock Clock;
+
+	double elapsed_ms(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	double ns_per_call(double ms, u32 calls)
+	{
+		return calls ? ms * 1000000.0 / calls : 0.0;
+	}
+
+	// Keeps the compiler from throwing away measurements whose results aren't used.
+	volatile s32 sink;
+
+	struct SCorpus
+	{
+		const char* name;
+		io::path font;
+		core::array<core::stringw> lines;
+	};
+
+	struct SResult
+	{
+		u32 characters;
+		double load_ms;
+		u32 cold_glyphs;
+		double cold_preload_ms;
+		double warm_preload_ms;
+		double dimension_cached_ns;
+		double dimension_uncached_ns;
+		double character_from_pos_ns;
+		double character_from_layout_ns;
+		double draw_cached_ns;
+		double draw_uncached_ns;
+		u32 draw_cached_allocations;
+		u32 draw_uncached_allocations;
+		u32 page_count;
+		u32 page_memory;
+	};
+
+	const wchar_t* const ascii_text[] =
+	{
+		L"The quick brown fox jumps over the lazy dog.",
+		L"Pack my box with five dozen liquor jugs!",
+		L"Sphinx of black quartz, judge my vow: 0123456789",
+		L"{curri} [app] (list) <node> \"quoted\" 'text' ~#@$%^&*_+=|/\\"
+	};
+
+	// Written with escapes so the file doesn't depend on the compiler's source character set.
+	const wchar_t* const latin1_text[] =
+	{
+		L"Voix ambigu\u00EB d'un gar\u00E7on qui, au z\u00E9phyr, pr\u00E9f\u00E8re les jattes de kiwis.",
+		L"Falsches \u00DCben von Xylophonmusik qu\u00E4lt jeden gr\u00F6\u00DFeren Zwerg.",
+		L"\u00A1El ping\u00FCino Wenceslao hizo kil\u00F3metros bajo exhaustiva lluvia y fr\u00EDo, a\u00F1oraba su querido n\u00E1car!",
+		L"\u00DEj\u00F3\u00F0in \u00ED \u00E1rs\u00E6lum \u00F6ngum; Sm\u00F8rbr\u00F8d \u00B1 \u00A3 \u00A5 \u00A7 \u00BC \u00BD \u00BE \u00D7 \u00F7"
+	};
+
+	void make_lines(core::array<core::stringw>& lines, const wchar_t* const* text, u32 count)
+	{
+		for (u32 i = 0; i < LINE_COUNT; ++i)
+			lines.push_back(text[i % count]);
+	}
+
+	// Lines of CJK unified ideographs picked with a fixed seed, so every run draws the same text.
+	void make_cjk_lines(core::array<core::stringw>& lines)
+	{
+		u32 seed = 12345;
+		for (u32 i = 0; i < LINE_COUNT; ++i)
+		{
+			core::stringw line;
+			for (u32 j = 0; j < CJK_LINE_LENGTH; ++j)
+			{
+				seed = seed * 1664525 + 1013904223;
+				line.append((wchar_t)(0x4E00 + (seed >> 8) % (0x9FA5 - 0x4E00 + 1)));
+			}
+			lines.push_back(line);
+		}
+	}
+
+	void draw_frame(IrrlichtDevice* device, CGUITTFont* font, const core::array<core::stringw>& lines)
+	{
+		video::IVideoDriver* driver = device->getVideoDriver();
+		device->run();
+		driver->beginScene(true, false, video::SColor(255, 255, 255, 255));
+		const s32 line_height = core::max_((s32)font->getVerticalMetrics().line_height, 1);
+		for (u32 i = 0; i < lines.size(); ++i)
+		{
+			const s32 y = (s32)(i % (SCREEN_HEIGHT / line_height)) * line_height;
+			const core::recti position(0, y, SCREEN_WIDTH, y + line_height);
+			count_allocations = true;
+			font->draw(lines[i], position, video::SColor(255, 0, 0, 0));
+			count_allocations = false;
+		}
+		driver->endScene();
+	}
+
+	bool run_corpus(IrrlichtDevice* device, const SCorpus& corpus, u32 size, u32 iterations, u32 threads, SResult& r)
+	{
+		const core::array<core::stringw>& lines = corpus.lines;
+		core::stringw all;
+		for (u32 i = 0; i < lines.size(); ++i)
+			all += lines[i];
+		r.characters = all.size();
+
+		// Load time, with the glyphs for ASCII that every font preloads.
+		Clock::time_point start = Clock::now();
+		for (u32 i = 0; i < FONT_LOADS; ++i)
+		{
+			CGUITTFont* font = CGUITTFont::createTTFont(device, corpus.font, size);
+			if (!font)
+				return false;
+			font->drop();
+		}
+		r.load_ms = elapsed_ms(start) / FONT_LOADS;
+
+		CGUITTFont* font = CGUITTFont::createTTFont(device, corpus.font, size);
+		if (!font)
+			return false;
+		font->setRasterizerThreadCount(threads);
+
+		// Cold preload renders every glyph the text needs.  Warm preload finds them all loaded.
+		const core::ustring text(all.c_str());
+		start = Clock::now();
+		r.cold_glyphs = font->preloadGlyphs(text);
+		r.cold_preload_ms = elapsed_ms(start);
+
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			sink = (s32)font->preloadGlyphs(text);
+		r.warm_preload_ms = elapsed_ms(start) / iterations;
+
+		// Measuring, from the layout cache and without it.
+		const u32 calls = iterations * lines.size();
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			for (u32 j = 0; j < lines.size(); ++j)
+				sink = (s32)font->getDimension(lines[j].c_str()).Width;
+		r.dimension_cached_ns = ns_per_call(elapsed_ms(start), calls);
+
+		font->setLayoutCacheSize(0);
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			for (u32 j = 0; j < lines.size(); ++j)
+				sink = (s32)font->getDimension(lines[j].c_str()).Width;
+		r.dimension_uncached_ns = ns_per_call(elapsed_ms(start), calls);
+		font->setLayoutCacheSize(256);
+
+		// Hit-testing across the width of each line, the way an edit box follows the mouse.
+		const s32 steps = 16;
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			for (u32 j = 0; j < lines.size(); ++j)
+				for (s32 x = 0; x < steps; ++x)
+					sink = font->getCharacterFromPos(lines[j].c_str(), x * (s32)SCREEN_WIDTH / steps);
+		r.character_from_pos_ns = ns_per_call(elapsed_ms(start), calls * steps);
+
+		// The same with the positions kept by the caller, which skips looking the text up.
+		core::array<SGUITTTextLayout> positions(lines.size());
+		for (u32 j = 0; j < lines.size(); ++j)
+		{
+			positions.push_back(SGUITTTextLayout());
+			font->getCharacterPositions(lines[j].c_str(), positions.getLast());
+		}
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			for (u32 j = 0; j < lines.size(); ++j)
+				for (s32 x = 0; x < steps; ++x)
+					sink = font->getCharacterFromPos(positions[j], x * (s32)SCREEN_WIDTH / steps);
+		r.character_from_layout_ns = ns_per_call(elapsed_ms(start), calls * steps);
+
+		// Drawing, once to fill the cache and upload the pages, then timed.
+		draw_frame(device, font, lines);
+		allocation_count = 0;
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			draw_frame(device, font, lines);
+		r.draw_cached_ns = ns_per_call(elapsed_ms(start), calls);
+		r.draw_cached_allocations = allocation_count;
+
+		// Without the cache every draw lays the text out again, into the font's scratch layout.
+		font->setLayoutCacheSize(0);
+		draw_frame(device, font, lines);
+		allocation_count = 0;
+		start = Clock::now();
+		for (u32 i = 0; i < iterations; ++i)
+			draw_frame(device, font, lines);
+		r.draw_uncached_ns = ns_per_call(elapsed_ms(start), calls);
+		r.draw_uncached_allocations = allocation_count;
+
+		r.page_count = font->getGlyphPageCount();
+		r.page_memory = font->getGlyphPageMemory();
+		font->drop();
+		return true;
+	}
+
+	void write_string(FILE* out, const char* s)
+	{
+		fputc('"', out);
+		for (; *s; ++s)
+		{
+			if (*s == '"' || *s == '\\')
+				fputc('\\', out);
+			if ((unsigned char)*s >= 0x20)
+				fputc(*s, out);
+		}
+		fputc('"', out);
+	}
+
+	void write_result(FILE* out, const SCorpus& corpus, const SResult& r, bool last)
+	{
+		fprintf(out, "\t\t{\n\t\t\t\"name\": ");
+		write_string(out, corpus.name);
+		fprintf(out, ",\n\t\t\t\"font\": ");
+		write_string(out, core::stringc(corpus.font).c_str());
+		fprintf(out, ",\n\t\t\t\"lines\": %u,\n\t\t\t\"characters\": %u,\n", corpus.lines.size(), r.characters);
+		fprintf(out, "\t\t\t\"load_ms\": %.3f,\n", r.load_ms);
+		fprintf(out, "\t\t\t\"cold_preload\": { \"glyphs\": %u, \"ms\": %.3f, \"glyphs_per_s\": %.0f },\n",
+			r.cold_glyphs, r.cold_preload_ms, r.cold_preload_ms > 0 ? r.cold_glyphs * 1000.0 / r.cold_preload_ms : 0.0);
+		fprintf(out, "\t\t\t\"warm_preload\": { \"ms\": %.3f, \"characters_per_s\": %.0f },\n",
+			r.warm_preload_ms, r.warm_preload_ms > 0 ? r.characters * 1000.0 / r.warm_preload_ms : 0.0);
+		fprintf(out, "\t\t\t\"get_dimension_ns\": { \"cached\": %.1f, \"uncached\": %.1f },\n",
+			r.dimension_cached_ns, r.dimension_uncached_ns);
+		fprintf(out, "\t\t\t\"get_character_from_pos_ns\": { \"text\": %.1f, \"layout\": %.1f },\n",
+			r.character_from_pos_ns, r.character_from_layout_ns);
+		fprintf(out, "\t\t\t\"draw_ns\": { \"cached\": %.1f, \"uncached\": %.1f },\n", r.draw_cached_ns, r.draw_uncached_ns);
+		fprintf(out, "\t\t\t\"draw_allocations\": { \"cached\": %u, \"uncached\": %u },\n",
+			r.draw_cached_allocations, r.draw_uncached_allocations);
+		fprintf(out, "\t\t\t\"glyph_pages\": %u,\n\t\t\t\"glyph_page_bytes\": %u\n", r.page_count, r.page_memory);
+		fprintf(out, "\t\t}%s\n", last ? "" : ",");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s font.ttf [--cjk-font file] [--driver null|burnings] [--size pixels] "
+			"[--iterations n] [--threads n] [--out file]\n", argv[0]);
+		return 2;
+	}
+
+	const char* font_file = argv[1];
+	const char* cjk_font_file = argv[1];
+	const char* driver_name = "null";
+	const char* out_file = 0;
+	u32 size = 16;
+	u32 iterations = 200;
+	u32 threads = 0;
+	for (int i = 2; i + 1 < argc; i += 2)
+	{
+		if (!strcmp(argv[i], "--cjk-font"))
+			cjk_font_file = argv[i + 1];
+		else if (!strcmp(argv[i], "--driver"))
+			driver_name = argv[i + 1];
+		else if (!strcmp(argv[i], "--size"))
+			size = (u32)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--iterations"))
+			iterations = (u32)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--threads"))
+			threads = (u32)atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "--out"))
+			out_file = argv[i + 1];
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (iterations == 0)
+		iterations = 1;
+
+	video::E_DRIVER_TYPE driver_type = video::EDT_NULL;
+	if (!strcmp(driver_name, "burnings"))
+		driver_type = video::EDT_BURNINGSVIDEO;
+	else if (strcmp(driver_name, "null"))
+	{
+		fprintf(stderr, "Unknown driver %s\n", driver_name);
+		return 2;
+	}
+
+	IrrlichtDevice* device = createDevice(driver_type, core::dimension2du(SCREEN_WIDTH, SCREEN_HEIGHT));
+	if (!device)
+	{
+		fprintf(stderr, "Couldn't create the %s device\n", driver_name);
+		return 1;
+	}
+	device->getLogger()->setLogLevel(ELL_ERROR);
+
+	SCorpus corpora[3];
+	corpora[0].name = "ascii";
+	corpora[0].font = font_file;
+	make_lines(corpora[0].lines, ascii_text, sizeof(ascii_text) / sizeof(ascii_text[0]));
+	corpora[1].name = "latin1";
+	corpora[1].font = font_file;
+	make_lines(corpora[1].lines, latin1_text, sizeof(latin1_text) / sizeof(latin1_text[0]));
+	corpora[2].name = "cjk";
+	corpora[2].font = cjk_font_file;
+	make_cjk_lines(corpora[2].lines);
+
+	FILE* out = out_file ? fopen(out_file, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "Couldn't write %s\n", out_file);
+		device->drop();
+		return 1;
+	}
+
+	fprintf(out, "{\n\t\"benchmark\": \"text_render\",\n\t\"driver\": ");
+	write_string(out, driver_name);
+	fprintf(out, ",\n\t\"size\": %u,\n\t\"iterations\": %u,\n\t\"rasterizer_threads\": %u,\n\t\"corpora\": [\n",
+		size, iterations, threads);
+
+	int result = 0;
+	const u32 corpus_count = sizeof(corpora) / sizeof(corpora[0]);
+	for (u32 i = 0; i < corpus_count; ++i)
+	{
+		SResult r;
+		memset(&r, 0, sizeof(r));
+		if (!run_corpus(device, corpora[i], size, iterations, threads, r))
+		{
+			fprintf(stderr, "Couldn't load %s\n", core::stringc(corpora[i].font).c_str());
+			result = 1;
+		}
+		write_result(out, corpora[i], r, i + 1 == corpus_count);
+
+		// Other drivers may allocate inside draw2DImageBatch(), so only the null driver is held to it.
+		if (driver_type == video::EDT_NULL && (r.draw_cached_allocations || r.draw_uncached_allocations))
+		{
+			fprintf(stderr, "%s: draw() allocated %u times with the layout cache and %u times without it\n",
+				corpora[i].name, r.draw_cached_allocations, r.draw_uncached_allocations);
+			result = 1;
+		}
+	}
+	fprintf(out, "\t]\n}\n");
+
+	if (out != stdout)
+		fclose(out);
+	device->drop();
+	return result;
+}
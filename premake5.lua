@@ -54,7 +54,8 @@ project "Curri App"
 		"Xext",
 		"X11",
 		"Xcursor",
-		"freetype" -- For CGUITTFont
+		"freetype", -- For CGUITTFont
+		"pthread" -- For the CGUITTFont glyph rasterizer threads
 	}
 	defines( "SYSTEM=Linux" )
 	-- TODO: Should move buildoptions to includedirs if supported.
@@ -93,3 +94,54 @@ project "Curri App"
 	linkoptions {
 		" -L" .. v_irrlicht_home .. "/lib"
 	}
+
+-- Micro-benchmark for the CGUITTFont glyph bitmap conversion kernels.
+-- Build with: make config=release pixel_convert
+project "pixel_convert"
+	targetname	"pixel_convert.out"
+	language	"C++"
+	cppdialect	"C++11"
+	kind		"ConsoleApp"
+	includedirs { "src" }
+	files {
+		"bench/pixel_convert.cpp"
+		, "src/font/CGUITTFont/CGUITTPixelConverter.h"
+		, "src/font/CGUITTFont/CGUITTPixelConverter.cpp"
+	}
+	buildoptions {
+		"-I" .. v_irrlicht_include
+	}
+
+-- Text rendering benchmark for CGUITTFont: load time, glyph preloading, measuring and drawing
+-- on a headless device.  Writes JSON for comparing runs.
+-- Build with: make config=release text_render
+-- Run with: ./text_render.out font.ttf [--cjk-font file] [--driver null|burnings] [--out results.json]
+project "text_render"
+	targetname	"text_render.out"
+	language	"C++"
+	cppdialect	"C++11"
+	kind		"ConsoleApp"
+	links {
+		"Irrlicht",
+		"GL",
+		"Xxf86vm",
+		"Xext",
+		"X11",
+		"Xcursor",
+		"freetype",
+		"pthread"
+	}
+	includedirs { "src" }
+	files {
+		"bench/text_render.cpp"
+		, "src/font/irrUString.h"
+		, "src/font/CGUITTFont/**.h"
+		, "src/font/CGUITTFont/**.cpp"
+	}
+	buildoptions {
+		"-I" .. v_irrlicht_include
+		, "-I" .. v_freetype_include
+	}
+	linkoptions {
+		" -L" .. v_irrlicht_home .. "/lib"
+	}
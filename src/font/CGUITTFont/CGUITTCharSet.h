@@ -0,0 +1,82 @@
+/*
+   Character set for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTCHARSET_H_INCLUDED__
+#define __C_GUI_TTCHARSET_H_INCLUDED__
+
+#include <irrlicht.h>
+#include <cstring>
+
+namespace irr
+{
+namespace gui
+{
+	//! A set of codepoints that can be tested in constant time, for checks made on every character drawn.
+	//! The Basic Multilingual Plane is a bitset.  Characters above it are rare enough to be kept in
+	//! a sorted array and binary searched.
+	class CGUITTCharSet
+	{
+		public:
+			CGUITTCharSet() { clear(); }
+
+			//! Removes every character.
+			void clear()
+			{
+				memset(bmp, 0, sizeof(bmp));
+				astral.set_used(0);
+			}
+
+			//! Adds a character.
+			void add(uchar32_t c)
+			{
+				if (c < 0x10000)
+				{
+					bmp[c >> 5] |= 1u << (c & 31);
+					return;
+				}
+
+				const u32 i = lower_bound(c);
+				if (i < astral.size() && astral[i] == c)
+					return;
+				astral.insert(c, i);
+			}
+
+			//! Returns true if the character is in the set.
+			bool contains(uchar32_t c) const
+			{
+				if (c < 0x10000)
+					return ((bmp[c >> 5] >> (c & 31)) & 1) != 0;
+
+				const u32 i = lower_bound(c);
+				return i < astral.size() && astral[i] == c;
+			}
+
+		private:
+			//! Returns the index of the first astral character not less than c.
+			u32 lower_bound(uchar32_t c) const
+			{
+				u32 first = 0;
+				u32 count = astral.size();
+				while (count > 0)
+				{
+					const u32 half = count >> 1;
+					if (astral[first + half] < c)
+					{
+						first += half + 1;
+						count -= half + 1;
+					}
+					else count = half;
+				}
+				return first;
+			}
+
+			u32 bmp[0x10000 / 32];
+			core::array<uchar32_t> astral;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTCHARSET_H_INCLUDED__
@@ -0,0 +1,128 @@
+/*
+   Read-only file mapping for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#include "CGUITTFileMapping.h"
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace irr
+{
+namespace gui
+{
+
+CGUITTFileMapping::CGUITTFileMapping()
+: data(0), size(0)
+#ifdef _WIN32
+, file_handle(INVALID_HANDLE_VALUE), mapping_handle(0)
+#endif
+{
+}
+
+CGUITTFileMapping::~CGUITTFileMapping()
+{
+	unmap();
+}
+
+#ifdef _WIN32
+
+bool CGUITTFileMapping::map(const io::path& filename)
+{
+	unmap();
+
+	#ifdef _IRR_WCHAR_FILESYSTEM
+	file_handle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	#else
+	file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	#endif
+	if (file_handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart <= 0 || file_size.QuadPart > 0x7FFFFFFF)
+	{
+		unmap();
+		return false;
+	}
+
+	mapping_handle = CreateFileMappingA(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping_handle)
+		data = static_cast<const u8*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		unmap();
+		return false;
+	}
+
+	size = (u32)file_size.QuadPart;
+	return true;
+}
+
+void CGUITTFileMapping::unmap()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(file_handle);
+
+	data = 0;
+	size = 0;
+	mapping_handle = 0;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool CGUITTFileMapping::map(const io::path& filename)
+{
+	unmap();
+
+	const core::stringc name(filename);
+	const int fd = open(name.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	// The mapping stays valid after the descriptor is closed.
+	struct stat info;
+	void* mapped = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0 && info.st_size <= 0x7FFFFFFF)
+		mapped = mmap(0, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = static_cast<const u8*>(mapped);
+	size = (u32)info.st_size;
+	return true;
+}
+
+void CGUITTFileMapping::unmap()
+{
+	if (data)
+		munmap(const_cast<u8*>(data), size);
+
+	data = 0;
+	size = 0;
+}
+
+#endif
+
+} // end namespace gui
+} // end namespace irr
@@ -0,0 +1,57 @@
+/*
+   Read-only file mapping for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTFILEMAPPING_H_INCLUDED__
+#define __C_GUI_TTFILEMAPPING_H_INCLUDED__
+
+#include <irrlicht.h>
+
+namespace irr
+{
+namespace gui
+{
+	//! Maps a file on disk into memory, read-only.
+	//! The pages are shared with every other process mapping the same file and are only read from
+	//! disk as they are touched, so large fonts cost neither startup I/O nor private memory.
+	class CGUITTFileMapping
+	{
+		public:
+			CGUITTFileMapping();
+
+			//! Unmaps the file.
+			~CGUITTFileMapping();
+
+			//! Maps a file, replacing any file mapped before.
+			//! \param filename A path on the real filesystem.  Files inside archives can't be mapped.
+			//! \return False if the file couldn't be mapped, for example because it is empty.
+			bool map(const io::path& filename);
+
+			//! Unmaps the file.
+			void unmap();
+
+			//! Returns the mapped data, or zero if nothing is mapped.
+			const u8* getData() const { return data; }
+
+			//! Returns the size of the mapped data in bytes.
+			u32 getSize() const { return size; }
+
+		private:
+			// Not copyable.
+			CGUITTFileMapping(const CGUITTFileMapping&);
+			CGUITTFileMapping& operator=(const CGUITTFileMapping&);
+
+			const u8* data;
+			u32 size;
+
+			#ifdef _WIN32
+			void* file_handle;
+			void* mapping_handle;
+			#endif
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTFILEMAPPING_H_INCLUDED__
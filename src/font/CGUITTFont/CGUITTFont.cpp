@@ -30,6 +30,12 @@
 
 #include <irrlicht.h>
 #include "CGUITTFont.h"
+#include "CGUITTTextSceneNode.h"
+#include "CGUITTPixelConverter.h"
+#include "CGUITTFileMapping.h"
+#include "CGUITTGLPageUploader.h"
+#include FT_SIZES_H
+#include FT_TRUETYPE_TABLES_H
 
 namespace irr
 {
@@ -46,13 +52,71 @@ struct SGUITTFace : public virtual irr::IReferenceCounted
 
 	~SGUITTFace()
 	{
+		// This also frees the size objects.
 		FT_Done_Face(face);
-		delete[] face_buffer;
+		if (!mapping.getData())
+			delete[] face_buffer;
+	}
+
+	//! Returns a size object for the pixel size, shared by every font using this face at that size.
+	//! \return Zero if FreeType couldn't make one.
+	FT_Size grabSize(u32 pixel_size)
+	{
+		for (u32 i = 0; i < sizes.size(); ++i)
+		{
+			if (sizes[i].pixel_size == pixel_size)
+			{
+				++sizes[i].users;
+				return sizes[i].size;
+			}
+		}
+
+		SSize entry;
+		entry.pixel_size = pixel_size;
+		entry.users = 1;
+		if (FT_New_Size(face, &entry.size) != FT_Err_Ok)
+			return 0;
+		FT_Activate_Size(entry.size);
+		if (FT_Set_Pixel_Sizes(face, 0, pixel_size) != FT_Err_Ok)
+		{
+			FT_Done_Size(entry.size);
+			return 0;
+		}
+		sizes.push_back(entry);
+		return entry.size;
+	}
+
+	//! Releases a size object from grabSize().
+	void dropSize(FT_Size size)
+	{
+		for (u32 i = 0; i < sizes.size(); ++i)
+		{
+			if (sizes[i].size == size)
+			{
+				if (--sizes[i].users == 0)
+				{
+					FT_Done_Size(size);
+					sizes.erase(i);
+				}
+				return;
+			}
+		}
 	}
 
 	FT_Face face;
 	FT_Byte* face_buffer;
 	FT_Long face_buffer_size;
+
+	//! If the font file is mapped, face_buffer points into the mapping.
+	CGUITTFileMapping mapping;
+
+	struct SSize
+	{
+		u32 pixel_size;
+		FT_Size size;
+		u32 users;
+	};
+	core::array<SSize> sizes;
 };
 
 // Static variables.
@@ -61,145 +125,540 @@ core::map<io::path, SGUITTFace*> CGUITTFont::c_faces;
 bool CGUITTFont::c_libraryLoaded = false;
 scene::IMesh* CGUITTFont::shared_plane_ptr_ = 0;
 scene::SMesh CGUITTFont::shared_plane_;
+video::IVideoDriver* CGUITTFont::c_glyphShaderDriver = 0;
+s32 CGUITTFont::c_glyphShaderMaterials[4] = { -1, -1, -1, -1 };
+
+//! Reads one character from a wide string and advances the pointer past it.
+//! Where wchar_t is 16 bits, UTF-16 surrogate pairs are combined into a single codepoint.
+static inline uchar32_t readWideChar(const wchar_t*& p)
+{
+	uchar32_t c = (uchar32_t)*p++;
+	if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDBFF && (uchar32_t)*p >= 0xDC00 && (uchar32_t)*p <= 0xDFFF)
+		c = 0x10000 + ((c - 0xD800) << 10) + ((uchar32_t)*p++ - 0xDC00);
+	return c;
+}
+
+//! Spaces a line can wrap at.  They hang past the wrap width instead of starting the next line.
+//! Figure space (U+2007) doesn't break, like no-break space.
+static inline bool isWrapSpace(uchar32_t c)
+{
+	return c == ' ' || c == '\t' || c == 0x3000 || (c >= 0x2000 && c <= 0x200A && c != 0x2007);
+}
+
+//! Characters of scripts written without spaces, which a line can wrap before or after.
+static inline bool isIdeographic(uchar32_t c)
+{
+	return (c >= 0x2E80 && c <= 0x9FFF)		// CJK radicals, kana and ideographs
+		|| (c >= 0xAC00 && c <= 0xD7A3)		// Hangul syllables
+		|| (c >= 0xF900 && c <= 0xFAFF)		// CJK compatibility ideographs
+		|| (c >= 0xFF01 && c <= 0xFF60)		// Fullwidth forms
+		|| (c >= 0x20000 && c <= 0x3FFFD);	// Supplementary ideographs
+}
+
+//! Punctuation that can't start a line.
+static inline bool isClosingPunctuation(uchar32_t c)
+{
+	switch (c)
+	{
+		case ',': case '.': case ':': case ';': case '!': case '?': case ')': case ']': case '}':
+		case 0x3001: case 0x3002: case 0x3009: case 0x300B: case 0x300D: case 0x300F: case 0x3011:
+		case 0x30FC: case 0xFF01: case 0xFF09: case 0xFF0C: case 0xFF0E: case 0xFF1A: case 0xFF1B: case 0xFF1F:
+			return true;
+	}
+	return false;
+}
+
+//! Punctuation that can't end a line.
+static inline bool isOpeningPunctuation(uchar32_t c)
+{
+	switch (c)
+	{
+		case '(': case '[': case '{':
+		case 0x3008: case 0x300A: case 0x300C: case 0x300E: case 0x3010: case 0xFF08:
+			return true;
+	}
+	return false;
+}
+
+//! Returns true if a line can wrap between two characters.
+//! This is a simplified form of the Unicode line breaking algorithm (UAX #14): it knows spaces,
+//! hyphens, CJK characters and the punctuation next to them, and the characters that glue words together.
+static bool canWrapBetween(uchar32_t before, uchar32_t after)
+{
+	// No-break space, narrow no-break space and word joiner.
+	if (before == 0xA0 || after == 0xA0 || before == 0x202F || after == 0x202F || before == 0x2060 || after == 0x2060)
+		return false;
+
+	// Spaces stay on the line before them.
+	if (isWrapSpace(after) || isClosingPunctuation(after) || isOpeningPunctuation(before))
+		return false;
+
+	// After spaces and zero width spaces.
+	if (isWrapSpace(before) || before == 0x200B)
+		return true;
+
+	// After hyphens, unless it's a minus sign in front of a number.
+	if (before == '-' || before == 0x2010 || before == 0x2013)
+		return !(after >= '0' && after <= '9');
 
-//
+	return isIdeographic(before) || isIdeographic(after);
+}
+
+//! Glyph cache file identification.  Bump the version whenever the layout of the file changes.
+static const u32 GLYPH_CACHE_MAGIC = 0x43545447; // "GTTC"
+static const u32 GLYPH_CACHE_VERSION = 3;
+
+//! Bytes hashed from each of the start, middle and end of a font file to identify it.
+static const u32 FONT_HASH_WINDOW = 4096;
+
+//! Continues an FNV-1a hash over some bytes.
+static inline u64 hashBytes(u64 hash, const void* data, u32 size)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	for (u32 i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return hash;
+}
+
+//! Writes a value to a glyph cache file in the machine's byte order.
+template <class T>
+static inline bool writeCacheValue(io::IWriteFile* file, const T& value)
+{
+	return file->write(&value, sizeof(T)) == sizeof(T);
+}
+
+//! Reads a value from glyph cache data and advances past it.
+template <class T>
+static inline bool readCacheValue(const u8*& data, const u8* end, T& value)
+{
+	if ((size_t)(end - data) < sizeof(T))
+		return false;
+	memcpy(&value, data, sizeof(T));
+	data += sizeof(T);
+	return true;
+}
+
+//////////////////////
 
-video::IImage* SGUITTGlyph::createGlyphImage(const FT_Bitmap& bits, video::IVideoDriver* driver) const
+bool CGUITTGlyphPage::createPageTexture(const u8& pixel_mode, const core::dimension2du& texture_size, bool single_channel)
 {
-	// Determine what our texture size should be.
-	// Add 1 because textures are inclusive-exclusive.
-	core::dimension2du d(bits.width + 1, bits.rows + 1);
-	core::dimension2du texture_size;
-	//core::dimension2du texture_size(bits.width + 1, bits.rows + 1);
+	if( texture )
+		return false;
+
+	bool flgmip = driver->getTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS);
+	driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, false);
 
-	// Create and load our image now.
-	video::IImage* image = 0;
-	switch (bits.pixel_mode)
+	this->pixel_mode = pixel_mode;
+
+	// Set the texture color format.
+	// Drivers can list ECF_R8 and still refuse to create or lock it, so a single channel page is
+	// only used once it has been locked.  Otherwise the page falls back to the usual format.
+	if (single_channel)
+	{
+		texture = driver->addTexture(texture_size, name, video::ECF_R8);
+		if (texture && texture->getColorFormat() == video::ECF_R8 && texture->lock(video::ETLM_WRITE_ONLY))
+		{
+			texture->unlock();
+			image = driver->createImage(video::ECF_R8, texture->getSize());
+		}
+		if (!image && texture)
+		{
+			driver->removeTexture(texture);
+			texture = 0;
+		}
+	}
+	if (!texture) switch (pixel_mode)
 	{
 		case FT_PIXEL_MODE_MONO:
+			texture = driver->addTexture(texture_size, name, video::ECF_A1R5G5B5);
+			break;
+		case FT_PIXEL_MODE_GRAY:
+		default:
+			texture = driver->addTexture(texture_size, name, video::ECF_A8R8G8B8);
+			break;
+	}
+
+	// Restore our texture creation flags.
+	driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, flgmip);
+
+	if (!texture)
+		return false;
+
+	// Keep our own copy of the page in the texture's actual format so uploads are plain copies.
+	if (!image)
+		image = driver->createImage(texture->getColorFormat(), texture->getSize());
+	if (!image)
+		return false;
+	if (image->getColorFormat() == video::ECF_R8)
+		memset(image->getData(), 0, image->getImageDataSizeInBytes());
+	else image->fill(video::SColor(0, 255, 255, 255));
+
+	// The first upload has to send the blank page along with any glyphs.
+	dirty = true;
+	needs_full_upload = true;
+
+	// The whole page starts out as a single empty skyline segment.
+	skyline.clear();
+	skyline.push_back(SSkylineNode(0, 0, texture->getOriginalSize().Width));
+
+	return true;
+}
+
+namespace
+{
+	//! Scales a FreeType gray level to 0-255.
+	inline u32 gray_level(u8 value, u32 num_grays)
+	{
+		return num_grays == 256 ? value : value * 255 / (num_grays - 1);
+	}
+}
+
+bool CGUITTGlyphPage::writeGlyph(const FT_Bitmap& bits, const core::vector2di& pos)
+{
+	if (bits.width == 0 || bits.rows == 0)
+		return true;
+	if (!image || (bits.pixel_mode != FT_PIXEL_MODE_MONO && bits.pixel_mode != FT_PIXEL_MODE_GRAY))
+		return false;
+
+	const SGUITTPixelConverter& convert = SGUITTPixelConverter::get();
+	const bool mono = (bits.pixel_mode == FT_PIXEL_MODE_MONO);
+	const u32 width = bits.width;
+	const u32 image_pitch = image->getPitch();
+	u8* dest = static_cast<u8*>(image->getData()) + pos.Y * image_pitch + pos.X * image->getBytesPerPixel();
+	const u8* src = bits.buffer;
+
+	// Monochrome bitmaps store 8 pixels per byte.  The left-most pixel is the bit 0x80.
+	for (u32 y = 0; y < (u32)bits.rows; ++y, dest += image_pitch, src += bits.pitch)
+	{
+		switch (image->getColorFormat())
 		{
-			// Create a blank image and fill it with transparent pixels.
-			texture_size = d.getOptimalSize(true, true);
-			image = driver->createImage(video::ECF_A1R5G5B5, texture_size);
-			image->fill(video::SColor(0, 255, 255, 255));
-
-			// Load the monochrome data in.
-			const u32 image_pitch = image->getPitch() / sizeof(u16);
-			u16* image_data = (u16*)image->getData(); // lock() removed in Irrlicht 1.9
-			u8* glyph_data = bits.buffer;
-			for (s32 y = 0; y < bits.rows; ++y)
+			case video::ECF_R8:
+				if (mono)
+					convert.monoToR8(dest, src, width);
+				else if (bits.num_grays == 256)
+					memcpy(dest, src, width);
+				else for (u32 x = 0; x < width; ++x)
+					dest[x] = (u8)gray_level(src[x], bits.num_grays);
+				break;
+
+			case video::ECF_A1R5G5B5:
 			{
-				u16* row = image_data;
-				for (s32 x = 0; x < bits.width; ++x)
-				{
-					// Monochrome bitmaps store 8 pixels per byte.  The left-most pixel is the bit 0x80.
-					// So, we go through the data each bit at a time.
-					if ((glyph_data[y * bits.pitch + (x / 8)] & (0x80 >> (x % 8))) != 0)
-						*row = 0xFFFF;
-					++row;
-				}
-				image_data += image_pitch;
+				u16* row = reinterpret_cast<u16*>(dest);
+				if (mono)
+					convert.monoToA1R5G5B5(row, src, width);
+				else for (u32 x = 0; x < width; ++x)
+					row[x] = gray_level(src[x], bits.num_grays) >= 128 ? 0xFFFF : 0x7FFF;
+				break;
 			}
-			//image->unlock(); // unlock removed in Irrlicht 1.9
-			break;
-		}
 
-		case FT_PIXEL_MODE_GRAY:
-		{
-			// Create our blank image.
-			texture_size = d.getOptimalSize(!driver->queryFeature(video::EVDF_TEXTURE_NPOT), !driver->queryFeature(video::EVDF_TEXTURE_NSQUARE), true, 0);
-			image = driver->createImage(video::ECF_A8R8G8B8, texture_size);
-			image->fill(video::SColor(0, 255, 255, 255));
-
-			// Load the grayscale data in.
-			const float gray_count = static_cast<float>(bits.num_grays);
-			const u32 image_pitch = image->getPitch() / sizeof(u32);
-			u32* image_data = (u32*)image->getData(); // lock() removed in Irrlicht 1.9
-			u8* glyph_data = bits.buffer;
-			for (s32 y = 0; y < bits.rows; ++y)
+			case video::ECF_A8R8G8B8:
 			{
-				u8* row = glyph_data;
-				for (s32 x = 0; x < bits.width; ++x)
+				u32* row = reinterpret_cast<u32*>(dest);
+				if (mono)
 				{
-					image_data[y * image_pitch + x] |= static_cast<u32>(255.0f * (static_cast<float>(*row++) / gray_count)) << 24;
-					//data[y * image_pitch + x] |= ((u32)(*bitsdata++) << 24);
+					for (u32 x = 0; x < width; ++x)
+						row[x] = (src[x >> 3] & (0x80 >> (x & 7))) ? 0xFFFFFFFF : 0x00FFFFFF;
 				}
-				glyph_data += bits.pitch;
+				else if (bits.num_grays == 256)
+					convert.grayToA8R8G8B8(row, src, width);
+				else for (u32 x = 0; x < width; ++x)
+					row[x] = (gray_level(src[x], bits.num_grays) << 24) | 0x00FFFFFF;
+				break;
 			}
-			//image->unlock(); // unlock removed in Irrlicht 1.9
-			break;
+
+			default:
+				return false;
 		}
-		default:
-			// TODO: error message?
-			return 0;
 	}
-	return image;
+
+	const core::recti rect(pos.X, pos.Y, pos.X + (s32)width, pos.Y + (s32)bits.rows);
+	if (has_dirty_rect)
+	{
+		dirty_rect.addInternalPoint(rect.UpperLeftCorner);
+		dirty_rect.addInternalPoint(rect.LowerRightCorner);
+	}
+	else dirty_rect = rect;
+	has_dirty_rect = true;
+	dirty = true;
+	return true;
 }
 
-void SGUITTGlyph::preload(u32 char_index, FT_Face face, video::IVideoDriver* driver, u32 font_size, const FT_Int32 loadFlags)
+void CGUITTGlyphPage::updateTexture()
 {
-	if (isLoaded) return;
+	if (!dirty) return;
+	dirty = false;
 
-	// Set the size of the glyph.
-	FT_Set_Pixel_Sizes(face, 0, font_size);
+	// The glyphs are already on our copy of the page, so only the texture is behind.
+	// Nothing to upload can happen when a glyph failed to render.
+	if (!has_dirty_rect && !needs_full_upload)
+		return;
+	has_dirty_rect = false;
 
-	// Attempt to load the glyph.
-	if (FT_Load_Glyph(face, char_index, loadFlags) != FT_Err_Ok)
-		// TODO: error message?
+	// Upload only the changed region if we can.
+	const u32 bytes_per_pixel = image->getBytesPerPixel();
+	const u32 image_pitch = image->getPitch();
+	if (uploader && !needs_full_upload)
+	{
+		const u8* region = static_cast<const u8*>(image->getData())
+			+ dirty_rect.UpperLeftCorner.Y * image_pitch + dirty_rect.UpperLeftCorner.X * bytes_per_pixel;
+		if (uploader->uploadRegion(texture, dirty_rect, region, image_pitch))
+			return;
+	}
+
+	// Fallback: replace the whole texture.  Since our copy of the page is complete, the texture
+	// is locked write-only, which spares the driver from reading it back first.
+	u8* dest = static_cast<u8*>(texture->lock(video::ETLM_WRITE_ONLY));
+	if (!dest)
 		return;
+	const u8* src = static_cast<const u8*>(image->getData());
+	const u32 texture_pitch = texture->getPitch();
+	const u32 row_size = core::min_(texture_pitch, image_pitch);
+	const u32 rows = core::min_(texture->getSize().Height, image->getDimension().Height);
+	for (u32 y = 0; y < rows; ++y)
+		memcpy(dest + y * texture_pitch, src + y * image_pitch, row_size);
+	texture->unlock();
+	needs_full_upload = false;
+}
 
-	FT_GlyphSlot glyph = face->glyph;
-	FT_Bitmap bits = glyph->bitmap;
+bool CGUITTGlyphPage::convertToA8R8G8B8()
+{
+	if (!isSingleChannel())
+		return true;
+
+	const core::dimension2du page_size = image->getDimension();
+	video::IImage* new_image = driver->createImage(video::ECF_A8R8G8B8, page_size);
+	if (!new_image)
+		return false;
+
+	bool flgmip = driver->getTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS);
+	driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, false);
+	video::ITexture* new_texture = driver->addTexture(texture->getOriginalSize(), name, video::ECF_A8R8G8B8);
+	driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, flgmip);
+	if (!new_texture || new_texture->getColorFormat() != video::ECF_A8R8G8B8)
+	{
+		if (new_texture)
+			driver->removeTexture(new_texture);
+		new_image->drop();
+		return false;
+	}
 
-	// Setup the glyph information here:
-	advance = glyph->advance;
-	offset = core::vector2di(glyph->bitmap_left, glyph->bitmap_top);
+	const SGUITTPixelConverter& convert = SGUITTPixelConverter::get();
+	const u8* src = static_cast<const u8*>(image->getData());
+	u8* dest = static_cast<u8*>(new_image->getData());
+	for (u32 y = 0; y < page_size.Height; ++y)
+		convert.grayToA8R8G8B8(reinterpret_cast<u32*>(dest + y * new_image->getPitch()), src + y * image->getPitch(), page_size.Width);
+
+	driver->removeTexture(texture);
+	texture = new_texture;
+	image->drop();
+	image = new_image;
+
+	// The packing state still holds, only the pixels have to go up again.
+	dirty = true;
+	needs_full_upload = true;
+	has_dirty_rect = false;
+	return true;
+}
 
-	// Try to get the last page with available slots.
-	CGUITTGlyphPage* page = parent->getLastGlyphPage();
+bool CGUITTGlyphPage::copyGlyph(video::IImage* source, const core::recti& source_rect, const core::vector2di& pos)
+{
+	if (!image || !source)
+		return false;
+
+	const video::ECOLOR_FORMAT source_format = source->getColorFormat();
+	const video::ECOLOR_FORMAT dest_format = image->getColorFormat();
+	if (source_format != dest_format && (source_format != video::ECF_R8 || dest_format != video::ECF_A8R8G8B8))
+		return false;
+
+	// Copied by hand, as the image blitters don't handle single channel images.
+	const SGUITTPixelConverter& convert = SGUITTPixelConverter::get();
+	const u32 source_bpp = source->getBytesPerPixel();
+	const u32 dest_bpp = image->getBytesPerPixel();
+	const u32 width = (u32)source_rect.getWidth();
+	const u8* src = static_cast<const u8*>(source->getData()) + source_rect.UpperLeftCorner.Y * source->getPitch() + source_rect.UpperLeftCorner.X * source_bpp;
+	u8* dest = static_cast<u8*>(image->getData()) + pos.Y * image->getPitch() + pos.X * dest_bpp;
+	for (s32 y = 0; y < source_rect.getHeight(); ++y, src += source->getPitch(), dest += image->getPitch())
+	{
+		if (source_format == dest_format)
+			memcpy(dest, src, width * dest_bpp);
+		else convert.grayToA8R8G8B8(reinterpret_cast<u32*>(dest), src, width);
+	}
 
-	// If we need to make a new page, do that now.
-	if (!page)
+	dirty = true;
+	return true;
+}
+
+bool CGUITTGlyphPage::writeCache(io::IWriteFile* file) const
+{
+	if (!image)
+		return false;
+
+	const u32 pitch = image->getPitch();
+	bool ok = writeCacheValue(file, (u32)image->getColorFormat())
+		&& writeCacheValue(file, pitch)
+		&& writeCacheValue(file, used_slots)
+		&& writeCacheValue(file, used_area)
+		&& writeCacheValue(file, wasted_area)
+		&& writeCacheValue(file, skyline.size());
+	for (u32 i = 0; ok && i < skyline.size(); ++i)
 	{
-		page = parent->createGlyphPage(bits.pixel_mode);
-		if (!page)
-			// TODO: add error message?
-			return;
+		ok = writeCacheValue(file, skyline[i].x)
+			&& writeCacheValue(file, skyline[i].y)
+			&& writeCacheValue(file, skyline[i].width);
 	}
 
-	glyph_page = parent->getLastGlyphPageIndex();
-	u32 texture_side_length = page->texture->getOriginalSize().Width;
-	core::vector2di page_position(
-		(page->used_slots % (texture_side_length / font_size)) * font_size,
-		(page->used_slots / (texture_side_length / font_size)) * font_size
-		);
-	source_rect.UpperLeftCorner = page_position;
-	source_rect.LowerRightCorner = core::vector2di(page_position.X + bits.width, page_position.Y + bits.rows);
+	const u32 bytes = pitch * image->getDimension().Height;
+	return ok && file->write(image->getData(), bytes) == bytes;
+}
 
-	page->dirty = true;
-	++page->used_slots;
-	--page->available_slots;
+bool CGUITTGlyphPage::readCache(const u8*& data, const u8* end)
+{
+	if (!image)
+		return false;
+
+	u32 format, pitch, skyline_count;
+	if (!readCacheValue(data, end, format) || !readCacheValue(data, end, pitch)
+		|| !readCacheValue(data, end, used_slots) || !readCacheValue(data, end, used_area)
+		|| !readCacheValue(data, end, wasted_area) || !readCacheValue(data, end, skyline_count))
+		return false;
+
+	// The pixels can only be used if the driver gave us the same kind of page as last time.
+	const core::dimension2du& page_size = image->getDimension();
+	if (format != (u32)image->getColorFormat() || pitch != image->getPitch())
+		return false;
+	if (skyline_count == 0 || skyline_count > page_size.Width)
+		return false;
+
+	// The skyline has to cover the page from left to right without gaps, or packing would write
+	// past the edges of the image.
+	skyline.clear();
+	skyline.reallocate(skyline_count);
+	s32 right = 0;
+	for (u32 i = 0; i < skyline_count; ++i)
+	{
+		SSkylineNode node;
+		if (!readCacheValue(data, end, node.x) || !readCacheValue(data, end, node.y) || !readCacheValue(data, end, node.width))
+			return false;
+		if (node.x != right || node.width <= 0 || node.width > (s32)page_size.Width - right
+			|| node.y < 0 || node.y > (s32)page_size.Height)
+			return false;
+		right += node.width;
+		skyline.push_back(node);
+	}
+	if (right != (s32)page_size.Width)
+		return false;
 
-	// We grab the glyph bitmap here so the data won't be removed when the next glyph is loaded.
-	surface = createGlyphImage(bits, driver);
+	const u32 bytes = pitch * page_size.Height;
+	if ((u32)(end - data) < bytes)
+		return false;
+	memcpy(image->getData(), data, bytes);
+	data += bytes;
 
-	// Set our glyph as loaded.
-	isLoaded = true;
+	dirty = true;
+	needs_full_upload = true;
+	return true;
+}
+
+s32 CGUITTGlyphPage::fitSkyline(u32 index, s32 width, s32 height) const
+{
+	const core::dimension2du& page_size = texture->getOriginalSize();
+	if (skyline[index].x + width > (s32)page_size.Width)
+		return -1;
+
+	// The rectangle rests on the highest segment it spans.
+	s32 y = skyline[index].y;
+	s32 width_left = width;
+	for (u32 i = index; width_left > 0; ++i)
+	{
+		if (skyline[i].y > y)
+			y = skyline[i].y;
+		if (y + height > (s32)page_size.Height)
+			return -1;
+		width_left -= skyline[i].width;
+	}
+	return y;
 }
 
-void SGUITTGlyph::unload()
+bool CGUITTGlyphPage::allocateRect(const core::dimension2du& rect_size, core::recti& out_rect)
 {
-	if (surface)
+	if (!texture || skyline.empty())
+		return false;
+
+	const s32 width = (s32)rect_size.Width;
+	const s32 height = (s32)rect_size.Height;
+
+	// Bottom-left best fit: take the position with the lowest resulting top edge,
+	// breaking ties with the narrowest segment so wide gaps stay available.
+	s32 best_index = -1;
+	s32 best_bottom = 0x7fffffff;
+	s32 best_width = 0x7fffffff;
+	s32 best_y = 0;
+	for (u32 i = 0; i < skyline.size(); ++i)
+	{
+		const s32 y = fitSkyline(i, width, height);
+		if (y < 0)
+			continue;
+
+		if (y + height < best_bottom || (y + height == best_bottom && skyline[i].width < best_width))
+		{
+			best_index = (s32)i;
+			best_bottom = y + height;
+			best_width = skyline[i].width;
+			best_y = y;
+		}
+	}
+
+	if (best_index < 0)
+		return false;
+
+	// Account for the space we skip over beneath the new rectangle.
+	s32 x = skyline[best_index].x;
+	s32 width_left = width;
+	for (u32 i = (u32)best_index; width_left > 0; ++i)
+	{
+		const s32 span = core::min_(width_left, skyline[i].width);
+		wasted_area += (u32)((best_y - skyline[i].y) * span);
+		width_left -= span;
+	}
+
+	// Insert the new segment and shrink or remove the segments it now covers.
+	skyline.insert(SSkylineNode(x, best_y + height, width), (u32)best_index);
+	for (u32 i = (u32)best_index + 1; i < skyline.size(); )
+	{
+		SSkylineNode& node = skyline[i];
+		const SSkylineNode& prev = skyline[i-1];
+		const s32 prev_end = prev.x + prev.width;
+		if (node.x >= prev_end)
+			break;
+
+		const s32 shrink = prev_end - node.x;
+		node.x += shrink;
+		node.width -= shrink;
+		if (node.width > 0)
+			break;
+		skyline.erase(i);
+	}
+
+	// Merge neighbouring segments at the same height.
+	for (u32 i = 0; i + 1 < skyline.size(); )
 	{
-		surface->drop();
-		surface = 0;
+		if (skyline[i].y == skyline[i+1].y)
+		{
+			skyline[i].width += skyline[i+1].width;
+			skyline.erase(i+1);
+		}
+		else ++i;
 	}
-	isLoaded = false;
+
+	out_rect = core::recti(x, best_y, x + width, best_y + height);
+	used_area += (u32)(width * height);
+	++used_slots;
+	return true;
 }
 
 //////////////////////
 
-CGUITTFont* CGUITTFont::createTTFont(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias, const bool transparency)
+CGUITTFont* CGUITTFont::createTTFont(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache)
 {
 	if (!c_libraryLoaded)
 	{
@@ -209,7 +668,7 @@ CGUITTFont* CGUITTFont::createTTFont(IGUIEnvironment *env, const io::path& filen
 	}
 
 	CGUITTFont* font = new CGUITTFont(env);
-	bool ret = font->load(filename, size, antialias, transparency);
+	bool ret = font->load(filename, size, antialias, transparency, glyph_cache);
 	if (!ret)
 	{
 		font->drop();
@@ -219,7 +678,7 @@ CGUITTFont* CGUITTFont::createTTFont(IGUIEnvironment *env, const io::path& filen
 	return font;
 }
 
-CGUITTFont* CGUITTFont::createTTFont(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias, const bool transparency)
+CGUITTFont* CGUITTFont::createTTFont(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache)
 {
 	if (!c_libraryLoaded)
 	{
@@ -230,7 +689,7 @@ CGUITTFont* CGUITTFont::createTTFont(IrrlichtDevice *device, const io::path& fil
 
 	CGUITTFont* font = new CGUITTFont(device->getGUIEnvironment());
 	font->Device = device;
-	bool ret = font->load(filename, size, antialias, transparency);
+	bool ret = font->load(filename, size, antialias, transparency, glyph_cache);
 	if (!ret)
 	{
 		font->drop();
@@ -240,14 +699,14 @@ CGUITTFont* CGUITTFont::createTTFont(IrrlichtDevice *device, const io::path& fil
 	return font;
 }
 
-CGUITTFont* CGUITTFont::create(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias, const bool transparency)
+CGUITTFont* CGUITTFont::create(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache)
 {
-	return CGUITTFont::createTTFont(env, filename, size, antialias, transparency);
+	return CGUITTFont::createTTFont(env, filename, size, antialias, transparency, glyph_cache);
 }
 
-CGUITTFont* CGUITTFont::create(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias, const bool transparency)
+CGUITTFont* CGUITTFont::create(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache)
 {
-	return CGUITTFont::createTTFont(device, filename, size, antialias, transparency);
+	return CGUITTFont::createTTFont(device, filename, size, antialias, transparency, glyph_cache);
 }
 
 //////////////////////
@@ -255,7 +714,10 @@ CGUITTFont* CGUITTFont::create(IrrlichtDevice *device, const io::path& filename,
 //! Constructor.
 CGUITTFont::CGUITTFont(IGUIEnvironment *env)
 : use_monochrome(false), use_transparency(true), use_hinting(true), use_auto_hinting(true),
-batch_load_size(1), Device(0), Environment(env), Driver(0), GlobalKerningWidth(0), GlobalKerningHeight(0)
+batch_load_size(1), Device(0), Environment(env), Driver(0), tt_face(0), tt_size(0), Page_Uploader(0), Rasterizer(0), Rasterizer_Threads(0),
+Async_Loading(false), Placeholder_Char(0), Commit_Budget(0), Commit_Frame_Count(0), Async_Pending(0), Pending_Lookups(0), Frame(0), Frame_Time(0), Page_Generation(0), Page_Budget(0), Repack_Frame(0),
+Layout_Cache_Size(256), Layout_Cache_Tick(0), Layout_Cache_Hits(0), Layout_Cache_Misses(0), Distance_Field_Spread(0), Single_Channel(false),
+GlobalKerningWidth(0), GlobalKerningHeight(0)
 {
 	#ifdef _DEBUG
 	setDebugName("CGUITTFont");
@@ -270,34 +732,15 @@ batch_load_size(1), Device(0), Environment(env), Driver(0), GlobalKerningWidth(0
 	if (Driver)
 		Driver->grab();
 
+	// Send only newly paged glyphs to the GPU where the driver allows it.
+	Page_Uploader = CGUITTGLPageUploader::create(Driver);
+
 	setInvisibleCharacters(L" ");
 
-	// Glyphs aren't reference counted, so don't try to delete them when we free the array.
-	Glyphs.set_free_when_destroyed(false);
 }
 
-bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antialias, const bool transparency)
+SGUITTFace* CGUITTFont::grab_face(const io::path& filename, io::IFileSystem* filesystem, irr::ILogger* logger)
 {
-	// Some sanity checks.
-	if (Environment == 0 || Driver == 0) return false;
-	if (size == 0) return false;
-	if (filename.size() == 0) return false;
-
-	io::IFileSystem* filesystem = Environment->getFileSystem();
-	irr::ILogger* logger = (Device != 0 ? Device->getLogger() : 0);
-	this->size = size;
-	this->filename = filename;
-
-	// Update the font loading flags when the font is first loaded.
-	this->use_monochrome = !antialias;
-	this->use_transparency = transparency;
-	update_load_flags();
-
-	// Log.
-	if (logger)
-		logger->log(L"CGUITTFont", core::stringw(core::stringw(L"Creating new font: ") + core::ustring(filename).toWCHAR_s() + L" " + core::stringc(size) + L"pt " + (antialias ? L"+antialias " : L"-antialias ") + (transparency ? L"+transparency" : L"-transparency")).c_str(), irr::ELL_INFORMATION);
-
-	// Grab the face.
 	SGUITTFace* face = 0;
 	core::map<io::path, SGUITTFace*>::Node* node = c_faces.find(filename);
 	if (node == 0)
@@ -316,11 +759,22 @@ bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antia
 				c_faces.remove(filename);
 				delete face;
 				face = 0;
-				return false;
+				return 0;
+			}
+
+			// Files on the real filesystem are mapped rather than read, so only the parts FreeType touches
+			// are loaded and other processes using the font share them.  Files in archives are read in.
+			if (file->getType() == io::ERFT_READ_FILE && face->mapping.map(file->getFileName()))
+			{
+				face->face_buffer = const_cast<FT_Byte*>(face->mapping.getData());
+				face->face_buffer_size = face->mapping.getSize();
+			}
+			else
+			{
+				face->face_buffer = new FT_Byte[file->getSize()];
+				file->read(face->face_buffer, file->getSize());
+				face->face_buffer_size = file->getSize();
 			}
-			face->face_buffer = new FT_Byte[file->getSize()];
-			file->read(face->face_buffer, file->getSize());
-			face->face_buffer_size = file->getSize();
 			file->drop();
 
 			// Create the face.
@@ -331,7 +785,7 @@ bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antia
 				c_faces.remove(filename);
 				delete face;
 				face = 0;
-				return false;
+				return 0;
 			}
 		}
 		else
@@ -344,7 +798,7 @@ bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antia
 				c_faces.remove(filename);
 				delete face;
 				face = 0;
-				return false;
+				return 0;
 			}
 		}
 	}
@@ -355,49 +809,17 @@ bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antia
 		face->grab();
 	}
 
-	// Store our face.
-	tt_face = face->face;
-
-	// Store font metrics.
-	FT_Set_Pixel_Sizes(tt_face, size, 0);
-	font_metrics = tt_face->size->metrics;
-
-	// Allocate our glyphs.
-	Glyphs.clear();
-	Glyphs.reallocate(tt_face->num_glyphs);
-	Glyphs.set_used(tt_face->num_glyphs);
-	for (FT_Long i = 0; i < tt_face->num_glyphs; ++i)
-	{
-		Glyphs[i].isLoaded = false;
-		Glyphs[i].glyph_page = 0;
-		Glyphs[i].source_rect = core::recti();
-		Glyphs[i].offset = core::vector2di();
-		Glyphs[i].advance = FT_Vector();
-		Glyphs[i].surface = 0;
-		Glyphs[i].parent = this;
-	}
-
-	// Cache the first 127 ascii characters.
-	u32 old_size = batch_load_size;
-	batch_load_size = 127;
-	getGlyphIndexByChar((uchar32_t)0);
-	batch_load_size = old_size;
-
-	return true;
+	return face;
 }
 
-CGUITTFont::~CGUITTFont()
+void CGUITTFont::drop_face(const io::path& filename, FT_Size face_size)
 {
-	// Delete the glyphs and glyph pages.
-	reset_images();
-	CGUITTAssistDelete::Delete(Glyphs);
-	//Glyphs.clear();
-
-	// We aren't using this face anymore.
 	core::map<io::path, SGUITTFace*>::Node* n = c_faces.find(filename);
 	if (n)
 	{
 		SGUITTFace* f = n->getValue();
+		if (face_size)
+			f->dropSize(face_size);
 
 		// Drop our face.  If this was the last face, the destructor will clean up.
 		if (f->drop())
@@ -410,67 +832,191 @@ CGUITTFont::~CGUITTFont()
 			c_libraryLoaded = false;
 		}
 	}
-
-	// Drop our driver now.
-	if (Driver)
-		Driver->drop();
 }
 
-void CGUITTFont::reset_images()
+bool CGUITTFont::load(const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache)
 {
-	// Delete the glyphs.
-	for (u32 i = 0; i != Glyphs.size(); ++i)
-		Glyphs[i].unload();
+	// Some sanity checks.
+	if (Environment == 0 || Driver == 0) return false;
+	if (size == 0) return false;
+	if (filename.size() == 0) return false;
 
-	// Unload the glyph pages from video memory.
-	for (u32 i = 0; i != Glyph_Pages.size(); ++i)
-		delete Glyph_Pages[i];
-	Glyph_Pages.clear();
+	io::IFileSystem* filesystem = Environment->getFileSystem();
+	irr::ILogger* logger = (Device != 0 ? Device->getLogger() : 0);
+	this->size = size;
 
-	// Always update the internal FreeType loading flags after resetting.
+	// Update the font loading flags when the font is first loaded.
+	this->use_monochrome = !antialias;
+	this->use_transparency = transparency;
 	update_load_flags();
-}
 
-void CGUITTFont::update_glyph_pages() const
-{
-	for (u32 i = 0; i != Glyph_Pages.size(); ++i)
+	// Log.
+	if (logger)
+		logger->log(L"CGUITTFont", core::stringw(core::stringw(L"Creating new font: ") + core::ustring(filename).toWCHAR_s() + L" " + core::stringc(size) + L"pt " + (antialias ? L"+antialias " : L"-antialias ") + (transparency ? L"+transparency" : L"-transparency")).c_str(), irr::ELL_INFORMATION);
+
+	// Grab the face.
+	tt_face = 0;
+	tt_size = 0;
+	SGUITTFace* face = grab_face(filename, filesystem, logger);
+	if (!face)
+		return false;
+
+	// Store our face, with a size object of our own.  FreeType can refuse the size, for example
+	// one a bitmap-only face doesn't have.
+	FT_Size face_size = face->grabSize(size);
+	if (!face_size)
 	{
-		if (Glyph_Pages[i]->dirty)
-			Glyph_Pages[i]->updateTexture();
+		drop_face(filename, 0);
+		return false;
 	}
-}
 
-CGUITTGlyphPage* CGUITTFont::getLastGlyphPage() const
-{
-	CGUITTGlyphPage* page = 0;
-	if (Glyph_Pages.empty())
-		return 0;
-	else
+	// From here on the destructor drops the face, so it must only know the filename once we hold it.
+	this->filename = filename;
+	tt_face = face->face;
+	tt_size = face_size;
+
+	// Store font metrics.  The line height needs glyphs, so it is worked out once they are loaded.
+	const FT_Size_Metrics& metrics = tt_size->metrics;
+	Vertical_Metrics.ascender = metrics.ascender / 64;
+	Vertical_Metrics.descender = metrics.descender / 64;
+	Vertical_Metrics.line_gap = (metrics.height - metrics.ascender + metrics.descender) / 64;
+	Vertical_Metrics.line_height = 0;
+
+	// Allocate our glyphs.
+	// Only the blocks of glyphs that get used are allocated.
+	Glyphs.resize(tt_face->num_glyphs);
+
+	if (Rasterizer_Threads > 0)
+		create_rasterizer();
+
+	// Restore the glyphs from a previous run if we can.
+	if (glyph_cache.size() == 0 || !loadGlyphCache(glyph_cache))
 	{
-		page = Glyph_Pages[getLastGlyphPageIndex()];
-		if (page->available_slots == 0)
-			page = 0;
+		// Cache the first 127 ascii characters.
+		u32 old_size = batch_load_size;
+		batch_load_size = 127;
+		getGlyphIndexByChar((uchar32_t)0);
+		batch_load_size = old_size;
 	}
-	return page;
+
+	get_line_height();
+	return true;
 }
 
-CGUITTGlyphPage* CGUITTFont::createGlyphPage(const u8& pixel_mode)
+CGUITTFont::~CGUITTFont()
 {
-	CGUITTGlyphPage* page = 0;
-	
-	// Name of our page.
-	io::path name("TTFontGlyphPage_");
-	name += tt_face->family_name;
-	name += ".";
-	name += tt_face->style_name;
-	name += ".";
-	name += size;
-	name += "_";
-	name += Glyph_Pages.size(); // The newly created page will be at the end of the collection.
+	// The rasterizer threads read the face data, so stop them before the face goes away.
+	delete Rasterizer;
+	Rasterizer = 0;
 
-	// Create the new page.
-	page = new CGUITTGlyphPage(Driver, name);
+	// Delete the glyphs and glyph pages.
+	reset_images();
+	setLayoutCacheSize(0);
+	Glyphs.resize(0);
+
+	// We aren't using these faces anymore.
+	for (u32 i = 0; i < Fallback_Faces.size(); ++i)
+	{
+		drop_face(Fallback_Faces[i]->filename, Fallback_Faces[i]->size);
+		delete Fallback_Faces[i];
+	}
+	Fallback_Faces.clear();
+	if (tt_face)
+		drop_face(filename, tt_size);
+
+	if (Page_Uploader)
+		Page_Uploader->drop();
+
+	// Drop our driver now.
+	if (Driver)
+		Driver->drop();
+}
+
+void CGUITTFont::reset_images()
+{
+	// Glyphs still being rendered were asked for with the old loading flags.
+	if (Rasterizer)
+		Rasterizer->cancel();
+	Async_Pending = 0;
+
+	// Delete the glyphs.
+	for (u32 slot = 0; slot <= Fallback_Faces.size(); ++slot)
+	{
+		CGUITTGlyphTable& glyphs = slot ? Fallback_Faces[slot - 1]->glyphs : Glyphs;
+		for (u32 i = 0; i != glyphs.size(); ++i)
+		{
+			SGUITTGlyph* glyph = glyphs.find(i);
+			if (glyph)
+				glyph->unload();
+		}
+	}
+
+	// Unload the glyph pages from video memory.
+	for (u32 i = 0; i != Glyph_Pages.size(); ++i)
+		delete Glyph_Pages[i];
+	Glyph_Pages.clear();
+
+	// Forget the cached glyph indices.
+	Char_Index_Table.clear();
+	Char_Index_Map.clear();
+
+	// The new loading flags can change the glyph heights.
+	Vertical_Metrics.line_height = 0;
+
+	// Cached layouts point into the old pages.
+	clearLayoutCache();
+	++Page_Generation;
+
+	// Always update the internal FreeType loading flags after resetting.
+	update_load_flags();
+}
+
+void CGUITTFont::update_glyph_pages() const
+{
+	for (u32 i = 0; i != Glyph_Pages.size(); ++i)
+	{
+		if (Glyph_Pages[i]->dirty)
+			Glyph_Pages[i]->updateTexture();
+	}
+}
+
+CGUITTGlyphPage* CGUITTFont::allocateGlyphRect(const core::dimension2du& glyph_size, const u8& pixel_mode, core::recti& out_rect, u32& out_page_index, bool new_page)
+{
+	// Leave a one pixel gutter to the right and below each glyph so filtering
+	// doesn't bleed neighbouring glyphs into each other.
+	const core::dimension2du padded(glyph_size.Width + 1, glyph_size.Height + 1);
+
+	// Newer pages are the most likely to have room, so check them first.
+	CGUITTGlyphPage* page = 0;
+	for (u32 i = Glyph_Pages.size(); i > 0 && !page; --i)
+	{
+		if (Glyph_Pages[i-1]->allocateRect(padded, out_rect))
+		{
+			page = Glyph_Pages[i-1];
+			out_page_index = i-1;
+		}
+	}
+
+	// If we need to make a new page, do that now.
+	if (!page && new_page)
+	{
+		page = createGlyphPage(pixel_mode);
+		if (!page || !page->allocateRect(padded, out_rect))
+			// TODO: add error message?
+			return 0;
+		out_page_index = getLastGlyphPageIndex();
+	}
+	if (!page)
+		return 0;
 
+	// The gutter isn't part of the glyph's source rectangle.
+	out_rect.LowerRightCorner = out_rect.UpperLeftCorner + core::vector2di(glyph_size.Width, glyph_size.Height);
+	page->dirty = true;
+	return page;
+}
+
+CGUITTGlyphPage* CGUITTFont::createGlyphPage(const u8& pixel_mode)
+{
 	// Determine our maximum texture size.
 	// If we keep getting 0, set it to 1024x1024, as that number is pretty safe.
 	core::dimension2du max_texture_size = max_page_texture_size;
@@ -490,143 +1036,1164 @@ CGUITTGlyphPage* CGUITTFont::createGlyphPage(const u8& pixel_mode)
 	if (page_texture_size.Width > max_texture_size.Width || page_texture_size.Height > max_texture_size.Height)
 		page_texture_size = max_texture_size;
 
-	if (!page->createPageTexture(pixel_mode, page_texture_size))
-		// TODO: add error message?
-		return 0;
+	return createGlyphPage(pixel_mode, page_texture_size);
+}
+
+CGUITTGlyphPage* CGUITTFont::createGlyphPage(const u8& pixel_mode, const core::dimension2du& texture_size)
+{
+	// Name of our page.
+	io::path name("TTFontGlyphPage_");
+	name += tt_face->family_name;
+	name += ".";
+	name += tt_face->style_name;
+	name += ".";
+	name += size;
+	name += "_";
+	name += Glyph_Pages.size(); // The newly created page will be at the end of the collection.
+
+	// Create the new page.
+	CGUITTGlyphPage* page = new CGUITTGlyphPage(Driver, name);
+	page->setUploader(Page_Uploader);
+
+	if (!page->createPageTexture(pixel_mode, texture_size, Single_Channel))
+	{
+		// TODO: add error message?
+		delete page;
+		return 0;
+	}
+
+	Glyph_Pages.push_back(page);
+
+	// The driver turned the single channel page down, so the font goes back to the usual format.
+	if (Single_Channel && !page->isSingleChannel())
+		disable_single_channel();
+	return page;
+}
+
+u64 CGUITTFont::get_font_hash() const
+{
+	// Hashing all of the font data would read in the whole of a mapped CJK font on every start,
+	// so only the size and the start, middle and end of the data are hashed.  Fonts opened straight
+	// from disk are identified by name instead.
+	u64 hash = 14695981039346656037ULL;
+	core::map<io::path, SGUITTFace*>::Node* node = c_faces.find(filename);
+	if (node && node->getValue()->face_buffer)
+	{
+		const SGUITTFace* face = node->getValue();
+		const u32 data_size = (u32)face->face_buffer_size;
+		const u32 window = core::min_(data_size, FONT_HASH_WINDOW);
+		hash = hashBytes(hash, &data_size, sizeof(data_size));
+		hash = hashBytes(hash, face->face_buffer, window);
+		hash = hashBytes(hash, face->face_buffer + (data_size - window) / 2, window);
+		hash = hashBytes(hash, face->face_buffer + data_size - window, window);
+	}
+	else hash = hashBytes(hash, filename.c_str(), filename.size() * sizeof(filename[0]));
+
+	// TrueType and OpenType fonts carry a checksum of the whole file and a revision date.
+	const TT_Header* head = static_cast<const TT_Header*>(FT_Get_Sfnt_Table(tt_face, FT_SFNT_HEAD));
+	if (head)
+	{
+		hash = hashBytes(hash, &head->CheckSum_Adjust, sizeof(head->CheckSum_Adjust));
+		hash = hashBytes(hash, &head->Font_Revision, sizeof(head->Font_Revision));
+		hash = hashBytes(hash, head->Modified, sizeof(head->Modified));
+	}
+	return (hash ^ (u64)tt_face->num_glyphs) * 1099511628211ULL;
+}
+
+bool CGUITTFont::saveGlyphCache(const io::path& cache_file) const
+{
+	io::IFileSystem* filesystem = Environment ? Environment->getFileSystem() : 0;
+	if (!filesystem || !tt_face)
+		return false;
+
+	// Make sure every loaded glyph is on its page.
+	update_glyph_pages();
+
+	io::IWriteFile* file = filesystem->createAndWriteFile(cache_file);
+	if (!file)
+		return false;
+
+	u32 loaded = 0;
+	for (u32 i = 0; i < Glyphs.size(); ++i)
+	{
+		const SGUITTGlyph* glyph = Glyphs.find(i);
+		if (glyph && glyph->isLoaded)
+			++loaded;
+	}
+
+	bool ok = writeCacheValue(file, GLYPH_CACHE_MAGIC)
+		&& writeCacheValue(file, GLYPH_CACHE_VERSION)
+		&& writeCacheValue(file, get_font_hash())
+		&& writeCacheValue(file, size)
+		&& writeCacheValue(file, (s32)load_flags)
+		&& writeCacheValue(file, Distance_Field_Spread)
+		&& writeCacheValue(file, Glyphs.size())
+		&& writeCacheValue(file, Glyph_Pages.size());
+
+	for (u32 i = 0; ok && i < Glyph_Pages.size(); ++i)
+	{
+		const CGUITTGlyphPage* page = Glyph_Pages[i];
+		const core::dimension2du& page_size = page->texture->getOriginalSize();
+		ok = writeCacheValue(file, (u32)page->getPixelMode())
+			&& writeCacheValue(file, page_size.Width)
+			&& writeCacheValue(file, page_size.Height)
+			&& page->writeCache(file);
+	}
+
+	ok = ok && writeCacheValue(file, loaded);
+	for (u32 i = 0; ok && i < Glyphs.size(); ++i)
+	{
+		const SGUITTGlyph* glyph = Glyphs.find(i);
+		if (!glyph || !glyph->isLoaded)
+			continue;
+
+		const core::recti source_rect = Glyphs.getSourceRect(i);
+		const core::vector2di offset = Glyphs.getOffset(i);
+		ok = writeCacheValue(file, i)
+			&& writeCacheValue(file, Glyphs.getPage(i))
+			&& writeCacheValue(file, source_rect.UpperLeftCorner.X)
+			&& writeCacheValue(file, source_rect.UpperLeftCorner.Y)
+			&& writeCacheValue(file, source_rect.LowerRightCorner.X)
+			&& writeCacheValue(file, source_rect.LowerRightCorner.Y)
+			&& writeCacheValue(file, offset.X)
+			&& writeCacheValue(file, offset.Y)
+			&& writeCacheValue(file, Glyphs.getAdvance(i));
+	}
+
+	file->drop();
+	return ok;
+}
+
+bool CGUITTFont::loadGlyphCache(const io::path& cache_file)
+{
+	io::IFileSystem* filesystem = Environment ? Environment->getFileSystem() : 0;
+	if (!filesystem || !tt_face)
+		return false;
+
+	io::IReadFile* file = filesystem->createAndOpenFile(cache_file);
+	if (!file)
+		return false;
+
+	// Read the whole file in one go and parse it from memory.
+	core::array<u8> buffer;
+	buffer.set_used(file->getSize());
+	const bool read = (file->read(buffer.pointer(), buffer.size()) == buffer.size());
+	file->drop();
+	if (!read)
+		return false;
+
+	const u8* data = buffer.const_pointer();
+	const u8* end = data + buffer.size();
+
+	u32 magic, version, cache_size, spread, glyph_count, page_count;
+	u64 hash;
+	s32 flags;
+	if (!readCacheValue(data, end, magic) || !readCacheValue(data, end, version)
+		|| !readCacheValue(data, end, hash) || !readCacheValue(data, end, cache_size)
+		|| !readCacheValue(data, end, flags) || !readCacheValue(data, end, spread)
+		|| !readCacheValue(data, end, glyph_count)
+		|| !readCacheValue(data, end, page_count))
+		return false;
+
+	if (magic != GLYPH_CACHE_MAGIC || version != GLYPH_CACHE_VERSION)
+		return false;
+	if (cache_size != size || flags != (s32)load_flags || spread != Distance_Field_Spread)
+		return false;
+	if (glyph_count != Glyphs.size() || hash != get_font_hash())
+		return false;
+
+	// From here on the file is meant for us, so anything wrong with it means it's damaged.
+	reset_images();
+
+	bool ok = true;
+	for (u32 i = 0; ok && i < page_count; ++i)
+	{
+		u32 pixel_mode;
+		core::dimension2du page_size;
+		ok = readCacheValue(data, end, pixel_mode)
+			&& readCacheValue(data, end, page_size.Width)
+			&& readCacheValue(data, end, page_size.Height);
+		if (!ok)
+			break;
+
+		CGUITTGlyphPage* page = createGlyphPage((u8)pixel_mode, page_size);
+		ok = page && page->readCache(data, end);
+	}
+
+	u32 loaded = 0;
+	ok = ok && readCacheValue(data, end, loaded);
+	for (u32 i = 0; ok && i < loaded; ++i)
+	{
+		u32 index, page;
+		s32 values[7];
+		ok = readCacheValue(data, end, index) && readCacheValue(data, end, page);
+		for (u32 j = 0; ok && j < 7; ++j)
+			ok = readCacheValue(data, end, values[j]);
+		if (!ok || index >= Glyphs.size() || page >= Glyph_Pages.size())
+		{
+			ok = false;
+			break;
+		}
+
+		// The glyph is copied out of its page when the pages are repacked, so it has to lie inside it.
+		const core::recti rect(values[0], values[1], values[2], values[3]);
+		const core::dimension2du& page_size = Glyph_Pages[page]->getImage()->getDimension();
+		if (rect.UpperLeftCorner.X < 0 || rect.UpperLeftCorner.Y < 0
+			|| rect.LowerRightCorner.X < rect.UpperLeftCorner.X || rect.LowerRightCorner.Y < rect.UpperLeftCorner.Y
+			|| rect.LowerRightCorner.X > (s32)page_size.Width || rect.LowerRightCorner.Y > (s32)page_size.Height)
+		{
+			ok = false;
+			break;
+		}
+
+		SGUITTGlyph& glyph = Glyphs[index];
+		Glyphs.setPlacement(index, page, rect);
+		Glyphs.setMetrics(index, values[6], core::vector2di(values[4], values[5]));
+		glyph.isLoaded = true;
+	}
+
+	if (!ok)
+	{
+		reset_images();
+		return false;
+	}
+	return true;
+}
+
+void CGUITTFont::setPageUploader(IGUITTPageUploader* page_uploader)
+{
+	if (page_uploader)
+		page_uploader->grab();
+	if (Page_Uploader)
+		Page_Uploader->drop();
+	Page_Uploader = page_uploader;
+
+	for (u32 i = 0; i != Glyph_Pages.size(); ++i)
+		Glyph_Pages[i]->setUploader(Page_Uploader);
+}
+
+void CGUITTFont::setRasterizerThreadCount(u32 count)
+{
+	if (count == Rasterizer_Threads)
+		return;
+
+	Rasterizer_Threads = count;
+	cancel_pending_glyphs();
+	delete Rasterizer;
+	Rasterizer = 0;
+
+	if (count > 0 && tt_face)
+		create_rasterizer();
+}
+
+void CGUITTFont::setAsyncGlyphLoading(bool enable)
+{
+	if (enable == Async_Loading)
+		return;
+
+	if (enable && Rasterizer_Threads == 0)
+		setRasterizerThreadCount(1);
+
+	if (!enable && Rasterizer && Async_Pending > 0)
+	{
+		// Wait for the queued glyphs rather than throwing them away.
+		core::array<u32> none;
+		core::array<SGUITTRasterizedGlyph> rendered;
+		Rasterizer->rasterize(none, load_flags, rendered);
+		for (u32 i = 0; i < rendered.size(); ++i)
+			commit_glyph(rendered[i]);
+	}
+
+	Async_Loading = enable;
+	cancel_pending_glyphs();
+	clearLayoutCache();
+}
+
+void CGUITTFont::begin_frame()
+{
+	// The device's virtual timer only advances once per frame, in run().
+	// Without a device, every draw counts as a frame of its own.
+	if (Device)
+	{
+		const u32 now = Device->getTimer()->getTime();
+		if (now == Frame_Time && Frame > 0)
+			return;
+		Frame_Time = now;
+	}
+
+	++Frame;
+	Commit_Frame_Count = 0;
+}
+
+void CGUITTFont::prepare_draw()
+{
+	begin_frame();
+
+	// Put glyphs loaded in the background on the pages.
+	commit_pending_glyphs();
+
+	// Keep a page free after trimming, so new glyphs don't push us straight back over the budget.
+	// Repack at most once a frame.  If the glyphs of a single frame don't fit, the pages stay over
+	// the budget until the next frame rather than being repacked and uploaded again on every draw.
+	if (Page_Budget > 0 && Glyph_Pages.size() > Page_Budget && Repack_Frame != Frame)
+	{
+		Repack_Frame = Frame;
+		repack_glyph_pages(Page_Budget > 1 ? Page_Budget - 1 : 1);
+	}
+}
+
+void CGUITTFont::compactGlyphPages(u32 unused_frames)
+{
+	for (u32 slot = 0; unused_frames > 0 && slot <= Fallback_Faces.size(); ++slot)
+	{
+		CGUITTGlyphTable& glyphs = slot ? Fallback_Faces[slot - 1]->glyphs : Glyphs;
+		for (u32 i = 0; i < glyphs.size(); ++i)
+		{
+			SGUITTGlyph* glyph = glyphs.find(i);
+			if (glyph && glyph->isLoaded && Frame - glyph->last_used > unused_frames)
+				glyph->unload();
+		}
+	}
+
+	repack_glyph_pages(0);
+}
+
+namespace
+{
+	//! Sorts glyphs with the most recently used first.
+	struct SGlyphAge
+	{
+		u32 handle;
+		u32 last_used;
+		bool operator<(const SGlyphAge& other) const { return last_used > other.last_used; }
+	};
+}
+
+void CGUITTFont::repack_glyph_pages(u32 max_pages)
+{
+	if (!Driver)
+		return;
+
+	core::array<SGlyphAge> order;
+	for (u32 slot = 0; slot <= Fallback_Faces.size(); ++slot)
+	{
+		const CGUITTGlyphTable& glyphs = slot ? Fallback_Faces[slot - 1]->glyphs : Glyphs;
+		for (u32 i = 0; i < glyphs.size(); ++i)
+		{
+			const SGUITTGlyph* glyph = glyphs.find(i);
+			if (glyph && glyph->isLoaded)
+			{
+				SGlyphAge age;
+				age.handle = (slot << GLYPH_SLOT_SHIFT) | (i + 1);
+				age.last_used = glyph->last_used;
+				order.push_back(age);
+			}
+		}
+	}
+	order.sort();
+
+	// Keep the old page images to copy the glyphs out of.  The old textures go first, so the new
+	// pages can take their names.
+	core::array<video::IImage*> old_images;
+	core::array<u8> old_modes;
+	for (u32 i = 0; i < Glyph_Pages.size(); ++i)
+	{
+		video::IImage* image = Glyph_Pages[i]->getImage();
+		if (image)
+			image->grab();
+		old_images.push_back(image);
+		old_modes.push_back(Glyph_Pages[i]->getPixelMode());
+		delete Glyph_Pages[i];
+	}
+	Glyph_Pages.clear();
+
+	// Pack the glyphs again, most recently used first, so if they don't all fit the coldest are the ones dropped.
+	// A glyph that doesn't fit only drops itself.  Smaller glyphs after it may still find room.
+	for (u32 i = 0; i < order.size(); ++i)
+	{
+		CGUITTGlyphTable& glyphs = get_table(order[i].handle);
+		const u32 index = table_index(order[i].handle);
+		const u32 old_page = glyphs.getPage(index);
+		video::IImage* source = old_images[old_page];
+
+		const core::recti source_rect = glyphs.getSourceRect(index);
+		const core::dimension2du glyph_size(source_rect.getWidth(), source_rect.getHeight());
+		core::recti rect;
+		u32 page_index;
+		const bool new_page = (max_pages == 0 || Glyph_Pages.size() < max_pages);
+		CGUITTGlyphPage* page = source ? allocateGlyphRect(glyph_size, old_modes[old_page], rect, page_index, new_page) : 0;
+		if (!page)
+		{
+			get_glyph(order[i].handle).unload();
+			continue;
+		}
+
+		page->copyGlyph(source, source_rect, rect.UpperLeftCorner);
+		glyphs.setPlacement(index, page_index, rect);
+	}
+
+	for (u32 i = 0; i < old_images.size(); ++i)
+	{
+		if (old_images[i])
+			old_images[i]->drop();
+	}
+
+	// The new pages upload in full the first time they are drawn.
+	clearLayoutCache();
+	++Page_Generation;
+}
+
+u32 CGUITTFont::getGlyphPageMemory() const
+{
+	u32 bytes = 0;
+	for (u32 i = 0; i < Glyph_Pages.size(); ++i)
+	{
+		const video::IImage* image = Glyph_Pages[i]->getImage();
+		if (image)
+			bytes += image->getImageDataSizeInBytes() * 2;
+	}
+	return bytes;
+}
+
+void CGUITTFont::commit_pending_glyphs()
+{
+	if (!Rasterizer || Async_Pending == 0)
+		return;
+
+	// The budget is per frame, counted from begin_frame().
+	u32 allowed = 0xFFFFFFFF;
+	if (Commit_Budget > 0)
+	{
+		if (Commit_Frame_Count >= Commit_Budget)
+			return;
+		allowed = Commit_Budget - Commit_Frame_Count;
+	}
+
+	core::array<SGUITTRasterizedGlyph> rendered;
+	Commit_Frame_Count += Rasterizer->collect(rendered, allowed);
+	for (u32 i = 0; i < rendered.size(); ++i)
+		commit_glyph(rendered[i]);
+}
+
+void CGUITTFont::commit_glyph(const SGUITTRasterizedGlyph& rendered) const
+{
+	SGUITTGlyph& glyph = Glyphs[rendered.glyph_index - 1];
+	if (glyph.isPending)
+	{
+		glyph.isPending = false;
+		--Async_Pending;
+	}
+	else if (glyph.isLoaded)
+	{
+		// Loaded on this thread while the rasterizer was still working on it.
+		return;
+	}
+
+	if (rendered.rendered)
+		place_glyph(rendered.glyph_index, rendered.getBitmap(), rendered.advance.x / 64, rendered.left, rendered.top);
+	else
+	{
+		// Load it as an empty glyph so it isn't queued again on every lookup.
+		FT_Bitmap empty;
+		memset(&empty, 0, sizeof(FT_Bitmap));
+		place_glyph(rendered.glyph_index, empty, 0, 0, 0);
+	}
+}
+
+void CGUITTFont::cancel_pending_glyphs()
+{
+	if (Async_Pending == 0)
+		return;
+
+	if (Rasterizer)
+		Rasterizer->cancel();
+	for (u32 i = 0; i < Glyphs.size(); ++i)
+	{
+		SGUITTGlyph* glyph = Glyphs.find(i);
+		if (glyph)
+			glyph->isPending = false;
+	}
+	Async_Pending = 0;
+}
+
+u32 CGUITTFont::pending_stand_in() const
+{
+	++Pending_Lookups;
+	if (Placeholder_Char == 0)
+		return 0;
+
+	// The placeholder itself is always loaded right away.
+	const u32 idx = getCachedCharIndex(Placeholder_Char);
+	if (idx == 0)
+		return 0;
+
+	SGUITTGlyph& glyph = get_glyph(idx);
+	if (!glyph.isLoaded && !glyph.isPending)
+		load_glyph(idx);
+	return glyph.isLoaded ? idx : 0;
+}
+
+void CGUITTFont::create_rasterizer()
+{
+	core::map<io::path, SGUITTFace*>::Node* node = c_faces.find(filename);
+	if (node == 0)
+		return;
+
+	// Faces opened from memory share their buffer with the workers.  Otherwise each worker opens the file.
+	SGUITTFace* face = node->getValue();
+	core::ustring converter(filename);
+	Rasterizer = new CGUITTGlyphRasterizer(face->face_buffer, face->face_buffer_size,
+		io::path(reinterpret_cast<const c8*>(converter.toUTF8_s().c_str())), size, Rasterizer_Threads);
+
+	if (Rasterizer->getThreadCount() == 0)
+	{
+		irr::ILogger* logger = (Device != 0 ? Device->getLogger() : 0);
+		if (logger) logger->log(L"CGUITTFont", L"Failed to start the glyph rasterizer threads.", irr::ELL_WARNING);
+
+		delete Rasterizer;
+		Rasterizer = 0;
+	}
+}
+
+void CGUITTFont::setTransparency(const bool flag)
+{
+	use_transparency = flag;
+	reset_images();
+}
+
+void CGUITTFont::setMonochrome(const bool flag)
+{
+	use_monochrome = flag;
+	reset_images();
+}
+
+void CGUITTFont::setFontHinting(const bool enable, const bool enable_auto_hinting)
+{
+	use_hinting = enable;
+	use_auto_hinting = enable_auto_hinting;
+	reset_images();
+}
+
+void CGUITTFont::setLayoutCacheSize(u32 entries)
+{
+	clearLayoutCache();
+	for (u32 i = 0; i < Layout_Cache.size(); ++i)
+		delete Layout_Cache[i];
+	Layout_Cache.clear();
+	Layout_Cache_Size = entries;
+}
+
+void CGUITTFont::clearLayoutCache()
+{
+	// Keep the entries themselves around so their arrays can be reused.
+	for (u32 i = 0; i < Layout_Cache.size(); ++i)
+	{
+		Layout_Cache[i]->laid_out = false;
+		Layout_Cache[i]->pending = false;
+		Layout_Cache[i]->has_advances = false;
+		Layout_Cache[i]->last_used = 0;
+		Layout_Cache[i]->text = L"";
+	}
+	Layout_Cache_Index.clear();
+}
+
+SGUITTTextLayout* CGUITTFont::findTextLayout(const wchar_t* text, s32 width, s32 height, bool hcenter, bool vcenter, s32 wrap_width, u64& out_key) const
+{
+	// FNV-1a over the text, then mix in the layout parameters.
+	u64 key = 14695981039346656037ULL;
+	for (const wchar_t* p = text; *p; ++p)
+	{
+		key ^= (u64)*p;
+		key *= 1099511628211ULL;
+	}
+	key ^= ((u64)(u32)width << 32) ^ ((u64)(u32)height << 2) ^ (hcenter ? 1 : 0) ^ (vcenter ? 2 : 0);
+	key ^= (u64)(u32)wrap_width * 0x9E3779B97F4A7C15ULL;
+	out_key = key;
+
+	const u32* slot = Layout_Cache_Index.find(key);
+	if (!slot)
+		return 0;
+
+	SGUITTTextLayout* layout = Layout_Cache[*slot];
+	if (layout->width != width || layout->height != height || layout->wrap_width != wrap_width
+		|| layout->hcenter != hcenter || layout->vcenter != vcenter || layout->text != text)
+		return 0;
+
+	layout->last_used = ++Layout_Cache_Tick;
+	return layout;
+}
+
+SGUITTTextLayout* CGUITTFont::addTextLayout(const wchar_t* text, s32 width, s32 height, bool hcenter, bool vcenter, s32 wrap_width, u64 key) const
+{
+	if (Layout_Cache_Size == 0)
+		return 0;
+
+	// Take a free entry if we have one, otherwise evict the least recently used.
+	u32 slot = Layout_Cache.size();
+	if (slot < Layout_Cache_Size)
+		Layout_Cache.push_back(new SGUITTTextLayout());
+	else
+	{
+		slot = 0;
+		for (u32 i = 1; i < Layout_Cache.size(); ++i)
+		{
+			if (Layout_Cache[i]->last_used < Layout_Cache[slot]->last_used)
+				slot = i;
+		}
+		const u32* indexed = Layout_Cache_Index.find(Layout_Cache[slot]->key);
+		if (indexed && *indexed == slot)
+			Layout_Cache_Index.remove(Layout_Cache[slot]->key);
+	}
+
+	SGUITTTextLayout* layout = Layout_Cache[slot];
+	layout->key = key;
+	layout->text = text;
+	layout->width = width;
+	layout->height = height;
+	layout->wrap_width = wrap_width;
+	layout->hcenter = hcenter;
+	layout->vcenter = vcenter;
+	layout->laid_out = false;
+	layout->pending = false;
+	layout->batch_count = 0;
+	layout->has_advances = false;
+	layout->last_used = ++Layout_Cache_Tick;
+	Layout_Cache_Index.set(key, slot);
+	return layout;
+}
+
+void CGUITTFont::layoutText(SGUITTTextLayout& layout, const core::rect<s32>& position)
+{
+	// Batches from an earlier layout are emptied, not freed, so their memory gets reused.
+	for (u32 i = 0; i < layout.batch_count; ++i)
+	{
+		layout.batches[i].positions.set_used(0);
+		layout.batches[i].source_rects.set_used(0);
+	}
+	layout.batch_count = 0;
+	layout.glyphs.set_used(0);
+	layout.origin = position.UpperLeftCorner;
+	const u32 pending_lookups = Pending_Lookups;
+
+	// Break the text into lines, then set up some variables.
+	const wchar_t* text = layout.text.c_str();
+	break_lines(text, layout.wrap_width, layout.lines);
+	layout.dimension = layout.wrap_width > 0 ? measure_lines(layout.lines) : measureText(text);
+	core::dimension2d<s32> textDimension(layout.dimension);
+	core::position2d<s32> offset = position.UpperLeftCorner;
+
+	// Determine offset positions.
+	if (layout.vcenter)
+		offset.Y = ((position.getHeight() - textDimension.Height) >> 1) + offset.Y;
+
+	// Maps page indices to the batch collecting that page's glyphs.
+	Page_Batch.set_used(0);
+
+	for (u32 l = 0; l < layout.lines.size(); ++l)
+	{
+		const SGUITTTextLayout::SLine& line = layout.lines[l];
+
+		// Unwrapped text is centered as a block, wrapped text line by line.
+		offset.X = position.UpperLeftCorner.X;
+		if (layout.hcenter)
+			offset.X += (position.getWidth() - (layout.wrap_width > 0 ? line.width : textDimension.Width)) >> 1;
+
+		// Start parsing characters.
+		uchar32_t previousChar = 0;
+		const wchar_t* p = text + line.begin;
+		const wchar_t* end = text + line.end;
+		while (p < end)
+		{
+			uchar32_t currentChar = readWideChar(p);
+			u32 n = getGlyphIndexByChar(currentChar);
+			bool visible = !Invisible.contains(currentChar);
+			if (n > 0 && visible)
+			{
+				// Calculate the glyph offset.
+				const CGUITTGlyphTable& glyphs = get_table(n);
+				const u32 index = table_index(n);
+				const core::vector2di glyph_offset = glyphs.getOffset(index);
+				const u32 glyph_page = glyphs.getPage(index);
+				s32 offx = glyph_offset.X;
+				s32 offy = Vertical_Metrics.ascender - glyph_offset.Y;
+
+				// Apply kerning.
+				core::vector2di k = getKerning(currentChar, previousChar);
+				offset.X += k.X;
+				offset.Y += k.Y;
+
+				// Determine rendering information.
+				while (Page_Batch.size() <= glyph_page)
+					Page_Batch.push_back(-1);
+				if (Page_Batch[glyph_page] < 0)
+				{
+					Page_Batch[glyph_page] = (s32)layout.batch_count;
+					if (layout.batch_count == layout.batches.size())
+						layout.batches.push_back(SGUITTTextLayout::SBatch());
+					layout.batches[layout.batch_count++].page = glyph_page;
+				}
+				SGUITTTextLayout::SBatch& batch = layout.batches[Page_Batch[glyph_page]];
+				batch.positions.push_back(core::position2di(offset.X + offx, offset.Y + offy));
+				batch.source_rects.push_back(glyphs.getSourceRect(index));
+				layout.glyphs.push_back(n);
+			}
+			offset.X += getWidthFromCharacter(currentChar);
+
+			previousChar = currentChar;
+		}
+		offset.Y += Vertical_Metrics.ascender;
+	}
+
+	layout.laid_out = true;
+	layout.pending = (Pending_Lookups != pending_lookups);
+}
+
+void CGUITTFont::draw(const core::stringw& text, const core::rect<s32>& position, video::SColor color, bool hcenter, bool vcenter, const core::rect<s32>* clip)
+{
+	if (!Driver)
+		return;
+
+	prepare_draw();
+
+	const SGUITTTextLayout& layout = get_layout(text, position, hcenter, vcenter, 0);
+
+	// Distance fields and single channel pages have to go through the shader, so they can't use the 2D image batch.
+	if (Distance_Field_Spread > 0 || Single_Channel)
+		draw_quads(layout, core::vector2df((f32)position.UpperLeftCorner.X, (f32)position.UpperLeftCorner.Y), 1.f, color, clip);
+	else draw_layout(layout, position.UpperLeftCorner, color, clip);
+}
+
+void CGUITTFont::drawWrapped(const core::stringw& text, const core::rect<s32>& position, video::SColor color, bool hcenter, bool vcenter, const core::rect<s32>* clip)
+{
+	if (!Driver)
+		return;
+
+	prepare_draw();
+
+	const SGUITTTextLayout& layout = get_layout(text, position, hcenter, vcenter, core::max_(position.getWidth(), 1));
+
+	if (Distance_Field_Spread > 0 || Single_Channel)
+		draw_quads(layout, core::vector2df((f32)position.UpperLeftCorner.X, (f32)position.UpperLeftCorner.Y), 1.f, color, clip);
+	else draw_layout(layout, position.UpperLeftCorner, color, clip);
+}
+
+void CGUITTFont::drawScaled(const core::stringw& text, const core::rect<s32>& position, f32 scale, video::SColor color, bool hcenter, bool vcenter, const core::rect<s32>* clip)
+{
+	if (!Driver)
+		return;
+
+	prepare_draw();
+
+	// Lay out at our own size and do the centering at the scaled size.
+	const SGUITTTextLayout& layout = get_layout(text, core::rect<s32>(0, 0, 0, 0), false, false, 0);
+	core::vector2df origin((f32)position.UpperLeftCorner.X, (f32)position.UpperLeftCorner.Y);
+	if (hcenter)
+		origin.X += (position.getWidth() - layout.dimension.Width * scale) * 0.5f;
+	if (vcenter)
+		origin.Y += (position.getHeight() - layout.dimension.Height * scale) * 0.5f;
+
+	draw_quads(layout, origin, scale, color, clip);
+}
+
+SGUITTTextLayout& CGUITTFont::get_layout(const core::stringw& text, const core::rect<s32>& position, bool hcenter, bool vcenter, s32 wrap_width)
+{
+	// The size of the rectangle only matters when centering.
+	const s32 width = hcenter ? position.getWidth() : 0;
+	const s32 height = vcenter ? position.getHeight() : 0;
+
+	// Reuse the layout from an earlier frame if the text hasn't changed.
+	u64 key;
+	SGUITTTextLayout* layout = findTextLayout(text.c_str(), width, height, hcenter, vcenter, wrap_width, key);
+	if (layout && layout->laid_out && !layout->pending)
+	{
+		++Layout_Cache_Hits;
+
+		// The glyphs weren't looked up, so mark them as used here.
+		for (u32 i = 0; i < layout->glyphs.size(); ++i)
+			get_glyph(layout->glyphs[i]).touch(Frame);
+	}
+	else
+	{
+		++Layout_Cache_Misses;
+		if (!layout)
+			layout = addTextLayout(text.c_str(), width, height, hcenter, vcenter, wrap_width, key);
+
+		// With the cache turned off, lay out into the scratch layout.
+		if (!layout)
+		{
+			layout = &Scratch_Layout;
+			layout->text = text;
+			layout->wrap_width = wrap_width;
+			layout->hcenter = hcenter;
+			layout->vcenter = vcenter;
+		}
+		layoutText(*layout, position);
+	}
+	return *layout;
+}
+
+void CGUITTFont::draw_layout(const SGUITTTextLayout& layout, const core::vector2di& origin, video::SColor color, const core::rect<s32>* clip)
+{
+	// Draw now.
+	update_glyph_pages();
+	if (!use_transparency) color.color |= 0xff000000;
+
+	const core::vector2di shift = origin - layout.origin;
+	for (u32 i = 0; i < layout.batch_count; ++i)
+	{
+		const SGUITTTextLayout::SBatch& batch = layout.batches[i];
+		CGUITTGlyphPage* page = Glyph_Pages[batch.page];
+
+		// Static text is drawn where it was laid out, so the positions can be used as they are.
+		if (shift.X == 0 && shift.Y == 0)
+		{
+			Driver->draw2DImageBatch(page->texture, batch.positions, batch.source_rects, clip, color, true);
+			continue;
+		}
+
+		page->render_positions.set_used(batch.positions.size());
+		for (u32 j = 0; j < batch.positions.size(); ++j)
+			page->render_positions[j] = batch.positions[j] + shift;
+		Driver->draw2DImageBatch(page->texture, page->render_positions, batch.source_rects, clip, color, true);
+	}
+}
+
+void CGUITTFont::draw_quads(const SGUITTTextLayout& layout, const core::vector2df& origin, f32 scale, video::SColor color, const core::rect<s32>* clip)
+{
+	update_glyph_pages();
+	if (!use_transparency) color.color |= 0xff000000;
+
+	video::SMaterial material;
+	material.MaterialType = getGlyphMaterialType();
+	material.Lighting = false;
+	material.ZBuffer = video::ECFN_DISABLED;
+	material.ZWriteEnable = false;
+	material.BackfaceCulling = false;
+	material.TextureLayer[0].BilinearFilter = true;
+	material.TextureLayer[0].TextureWrapU = video::ETC_CLAMP_TO_EDGE;
+	material.TextureLayer[0].TextureWrapV = video::ETC_CLAMP_TO_EDGE;
+
+	// Draw in screen pixels, with the origin in the upper left corner.
+	const core::matrix4 old_projection = Driver->getTransform(video::ETS_PROJECTION);
+	const core::matrix4 old_view = Driver->getTransform(video::ETS_VIEW);
+	const core::matrix4 old_world = Driver->getTransform(video::ETS_WORLD);
+	const core::dimension2du& target_size = Driver->getCurrentRenderTargetSize();
+	core::matrix4 projection;
+	projection[0] = 2.f / target_size.Width;
+	projection[5] = -2.f / target_size.Height;
+	projection[12] = -1.f;
+	projection[13] = 1.f;
+	Driver->setTransform(video::ETS_PROJECTION, projection);
+	Driver->setTransform(video::ETS_VIEW, core::matrix4());
+	Driver->setTransform(video::ETS_WORLD, core::matrix4());
+
+	for (u32 i = 0; i < layout.batch_count; ++i)
+	{
+		const SGUITTTextLayout::SBatch& batch = layout.batches[i];
+		CGUITTGlyphPage* page = Glyph_Pages[batch.page];
+		const core::dimension2du& page_size = page->texture->getOriginalSize();
+		const f32 inv_width = 1.f / page_size.Width;
+		const f32 inv_height = 1.f / page_size.Height;
+		material.setTexture(0, page->texture);
+		Driver->setMaterial(material);
+
+		Quad_Vertices.set_used(0);
+		Quad_Indices.set_used(0);
+		for (u32 j = 0; j < batch.positions.size(); ++j)
+		{
+			const core::recti& source = batch.source_rects[j];
+			f32 x0 = origin.X + (batch.positions[j].X - layout.origin.X) * scale;
+			f32 y0 = origin.Y + (batch.positions[j].Y - layout.origin.Y) * scale;
+			f32 x1 = x0 + source.getWidth() * scale;
+			f32 y1 = y0 + source.getHeight() * scale;
+			f32 u0 = source.UpperLeftCorner.X * inv_width;
+			f32 v0 = source.UpperLeftCorner.Y * inv_height;
+			f32 u1 = source.LowerRightCorner.X * inv_width;
+			f32 v1 = source.LowerRightCorner.Y * inv_height;
+
+			// Clip the quad, moving the texture coordinates along with its edges.
+			if (clip)
+			{
+				const f32 du = (u1 - u0) / (x1 - x0);
+				const f32 dv = (v1 - v0) / (y1 - y0);
+				if (x0 < clip->UpperLeftCorner.X) { u0 += (clip->UpperLeftCorner.X - x0) * du; x0 = (f32)clip->UpperLeftCorner.X; }
+				if (y0 < clip->UpperLeftCorner.Y) { v0 += (clip->UpperLeftCorner.Y - y0) * dv; y0 = (f32)clip->UpperLeftCorner.Y; }
+				if (x1 > clip->LowerRightCorner.X) { u1 -= (x1 - clip->LowerRightCorner.X) * du; x1 = (f32)clip->LowerRightCorner.X; }
+				if (y1 > clip->LowerRightCorner.Y) { v1 -= (y1 - clip->LowerRightCorner.Y) * dv; y1 = (f32)clip->LowerRightCorner.Y; }
+				if (x0 >= x1 || y0 >= y1)
+					continue;
+			}
+
+			const u16 first = (u16)Quad_Vertices.size();
+			Quad_Vertices.push_back(video::S3DVertex(x0, y0, 0.f, 0.f, 0.f, -1.f, color, u0, v0));
+			Quad_Vertices.push_back(video::S3DVertex(x1, y0, 0.f, 0.f, 0.f, -1.f, color, u1, v0));
+			Quad_Vertices.push_back(video::S3DVertex(x1, y1, 0.f, 0.f, 0.f, -1.f, color, u1, v1));
+			Quad_Vertices.push_back(video::S3DVertex(x0, y1, 0.f, 0.f, 0.f, -1.f, color, u0, v1));
+			Quad_Indices.push_back(first);
+			Quad_Indices.push_back(first + 1);
+			Quad_Indices.push_back(first + 2);
+			Quad_Indices.push_back(first);
+			Quad_Indices.push_back(first + 2);
+			Quad_Indices.push_back(first + 3);
+
+			// Stay within 16-bit indices.
+			if (Quad_Vertices.size() > 0xFFFF - 4)
+			{
+				Driver->drawVertexPrimitiveList(Quad_Vertices.const_pointer(), Quad_Vertices.size(), Quad_Indices.const_pointer(), Quad_Indices.size() / 3);
+				Quad_Vertices.set_used(0);
+				Quad_Indices.set_used(0);
+			}
+		}
 
-	if (page)
-	{
-		// Determine the number of glyph slots on the page and add it to the list of pages.
-		page->available_slots = (page_texture_size.Width / size) * (page_texture_size.Height / size);
-		Glyph_Pages.push_back(page);
+		if (Quad_Vertices.size() > 0)
+			Driver->drawVertexPrimitiveList(Quad_Vertices.const_pointer(), Quad_Vertices.size(), Quad_Indices.const_pointer(), Quad_Indices.size() / 3);
 	}
-	return page;
+
+	Driver->setTransform(video::ETS_PROJECTION, old_projection);
+	Driver->setTransform(video::ETS_VIEW, old_view);
+	Driver->setTransform(video::ETS_WORLD, old_world);
 }
 
-void CGUITTFont::setTransparency(const bool flag)
+video::E_MATERIAL_TYPE CGUITTFont::getGlyphMaterialType()
 {
-	use_transparency = flag;
-	reset_images();
+	return get_glyph_shader_material(Distance_Field_Spread > 0, Single_Channel);
 }
 
-void CGUITTFont::setMonochrome(const bool flag)
+bool CGUITTFont::getTextLayout(const core::stringw& text, SGUITTTextLayout& layout, s32 wrap_width)
 {
-	use_monochrome = flag;
-	reset_images();
+	// No repacking here.  It would move the glyphs of text laid out earlier in the frame.
+	begin_frame();
+	commit_pending_glyphs();
+
+	layout.text = text;
+	layout.wrap_width = wrap_width;
+	layout.hcenter = false;
+	layout.vcenter = false;
+	layoutText(layout, core::rect<s32>(0, 0, 0, 0));
+
+	// The caller draws straight from the page textures.
+	update_glyph_pages();
+	return !layout.pending;
 }
 
-void CGUITTFont::setFontHinting(const bool enable, const bool enable_auto_hinting)
+bool CGUITTFont::has_glyph_shaders() const
 {
-	use_hinting = enable;
-	use_auto_hinting = enable_auto_hinting;
-	reset_images();
+	return Driver && Driver->getGPUProgrammingServices() && Driver->getDriverType() == video::EDT_OPENGL
+		&& Driver->queryFeature(video::EVDF_ARB_GLSL);
 }
 
-void CGUITTFont::draw(const core::stringw& text, const core::rect<s32>& position, video::SColor color, bool hcenter, bool vcenter, const core::rect<s32>* clip)
+video::E_MATERIAL_TYPE CGUITTFont::get_glyph_shader_material(bool distance_field, bool single_channel)
 {
-	if (!Driver)
-		return;
-
-	// Clear the glyph pages of their render information.
-	for (u32 i = 0; i < Glyph_Pages.size(); ++i)
+	if (c_glyphShaderDriver != Driver)
 	{
-		Glyph_Pages[i]->render_positions.clear();
-		Glyph_Pages[i]->render_source_rects.clear();
+		c_glyphShaderDriver = Driver;
+		for (u32 i = 0; i < 4; ++i)
+			c_glyphShaderMaterials[i] = -1;
+
+		// Single channel pages keep the glyph in red rather than alpha.
+		// A distance field edge is where the field crosses one half.  fwidth() gives how much the field
+		// changes across one screen pixel, which keeps the edge about a pixel wide at any scale.
+		static const c8* vertex_shader =
+			"void main()\n"
+			"{\n"
+			"	gl_Position = ftransform();\n"
+			"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+			"	gl_FrontColor = gl_Color;\n"
+			"}\n";
+		static const c8* pixel_shaders[4] =
+		{
+			// Plain pages are drawn by the fixed function pipeline.
+			0,
+
+			"uniform sampler2D Texture;\n"
+			"void main()\n"
+			"{\n"
+			"	float d = texture2D(Texture, gl_TexCoord[0].xy).a;\n"
+			"	float w = 0.7 * fwidth(d);\n"
+			"	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * smoothstep(0.5 - w, 0.5 + w, d));\n"
+			"}\n",
+
+			"uniform sampler2D Texture;\n"
+			"void main()\n"
+			"{\n"
+			"	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * texture2D(Texture, gl_TexCoord[0].xy).r);\n"
+			"}\n",
+
+			"uniform sampler2D Texture;\n"
+			"void main()\n"
+			"{\n"
+			"	float d = texture2D(Texture, gl_TexCoord[0].xy).r;\n"
+			"	float w = 0.7 * fwidth(d);\n"
+			"	gl_FragColor = vec4(gl_Color.rgb, gl_Color.a * smoothstep(0.5 - w, 0.5 + w, d));\n"
+			"}\n"
+		};
+
+		if (has_glyph_shaders())
+		{
+			video::IGPUProgrammingServices* gpu = Driver->getGPUProgrammingServices();
+			for (u32 i = 1; i < 4; ++i)
+			{
+				c_glyphShaderMaterials[i] = gpu->addHighLevelShaderMaterial(vertex_shader, "main", video::EVST_VS_1_1,
+					pixel_shaders[i], "main", video::EPST_PS_1_1, 0, video::EMT_TRANSPARENT_ALPHA_CHANNEL);
+			}
+		}
 	}
 
-	// Set up some variables.
-	core::dimension2d<s32> textDimension;
-	core::position2d<s32> offset = position.UpperLeftCorner;
+	const s32 material = c_glyphShaderMaterials[(distance_field ? 1 : 0) | (single_channel ? 2 : 0)];
+	if (material >= 0)
+		return (video::E_MATERIAL_TYPE)material;
 
-	// Determine offset positions.
-	if (hcenter || vcenter)
+	// Without shaders, cut the field at one half.  Edges are aliased but stay sharp.
+	return distance_field ? video::EMT_TRANSPARENT_ALPHA_CHANNEL_REF : video::EMT_TRANSPARENT_ALPHA_CHANNEL;
+}
+
+bool CGUITTFont::setSingleChannelPages(bool enable)
+{
+	// Only our shader knows to read the glyphs out of the red channel.
+	bool single_channel = enable && has_glyph_shaders() && Driver->queryTextureFormat(video::ECF_R8);
+	if (single_channel && !Single_Channel)
+	{
+		// Try a small page before throwing the current ones away.
+		CGUITTGlyphPage probe(Driver, "TTFontGlyphPage_SingleChannelProbe");
+		single_channel = probe.createPageTexture(FT_PIXEL_MODE_GRAY, core::dimension2du(16, 16), true) && probe.isSingleChannel();
+	}
+	if (single_channel != Single_Channel)
 	{
-		textDimension = getDimension(text.c_str());
+		Single_Channel = single_channel;
+		reset_images();
+	}
+	return Single_Channel;
+}
 
-		if (hcenter)
-			offset.X = ((position.getWidth() - textDimension.Width) >> 1) + offset.X;
+void CGUITTFont::disable_single_channel()
+{
+	Single_Channel = false;
 
-		if (vcenter)
-			offset.Y = ((position.getHeight() - textDimension.Height) >> 1) + offset.Y;
-	}
+	// Keep the glyphs already packed, on pages the default material can draw.
+	for (u32 i = 0; i < Glyph_Pages.size(); ++i)
+		Glyph_Pages[i]->convertToA8R8G8B8();
+	++Page_Generation;
+}
+
+void CGUITTFont::setDistanceField(bool enable, u32 spread)
+{
+	const u32 new_spread = enable ? core::max_(spread, 1u) : 0;
+	if (new_spread == Distance_Field_Spread)
+		return;
 
-	// Convert to a unicode string.
-	core::ustring utext(text);
+	Distance_Field_Spread = new_spread;
+	reset_images();
+}
 
-	// Set up our render map.
-	core::map<u32, CGUITTGlyphPage*> Render_Map;
+void CGUITTFont::makeDistanceField(const FT_Bitmap& bits, FT_Bitmap& out)
+{
+	const s32 spread = (s32)Distance_Field_Spread;
+	const s32 width = bits.width + spread * 2;
+	const s32 rows = bits.rows + spread * 2;
+	const s32 cells = width * rows;
+
+	// Coverage of a pixel of the padded glyph, from 0 to 1.
+	Distance_Field_Buffer.set_used(cells);
+	u8* coverage = Distance_Field_Buffer.pointer();
+	memset(coverage, 0, cells);
+	for (s32 y = 0; y < (s32)bits.rows; ++y)
+	{
+		const u8* row = bits.buffer + y * bits.pitch;
+		u8* dest = coverage + (y + spread) * width + spread;
+		for (s32 x = 0; x < (s32)bits.width; ++x)
+		{
+			if (bits.pixel_mode == FT_PIXEL_MODE_MONO)
+				dest[x] = (row[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0;
+			else dest[x] = (u8)(row[x] * 255 / core::max_(bits.num_grays - 1, 1));
+		}
+	}
 
-	// Start parsing characters.
-	u32 n;
-	uchar32_t previousChar = 0;
-	core::ustring::const_iterator iter(utext);
-	while (!iter.atEnd())
+	// 8SSEDT: every cell holds the offset to its nearest seed.  Two grids are run, one seeded with the
+	// pixels inside the outline and one with those outside.
+	const s32 far_away = 0x3FFF;
+	Distance_Field_Grid.set_used(cells * 4);
+	s32* grids[2] = { Distance_Field_Grid.pointer(), Distance_Field_Grid.pointer() + cells * 2 };
+	for (s32 i = 0; i < cells; ++i)
+	{
+		const bool inside = coverage[i] >= 128;
+		grids[0][i * 2] = grids[0][i * 2 + 1] = inside ? 0 : far_away;
+		grids[1][i * 2] = grids[1][i * 2 + 1] = inside ? far_away : 0;
+	}
+
+	for (u32 g = 0; g < 2; ++g)
 	{
-		uchar32_t currentChar = *iter;
-		n = getGlyphIndexByChar(currentChar);
-		bool visible = (Invisible.findFirst(currentChar) == -1);
-		if (n > 0 && visible)
+		s32* grid = grids[g];
+		#define CGUITT_EDT_COMPARE(ox, oy) \
+		{ \
+			const s32 nx = x + (ox), ny = y + (oy); \
+			if (nx >= 0 && nx < width && ny >= 0 && ny < rows) \
+			{ \
+				s32* c = grid + (y * width + x) * 2; \
+				const s32* n = grid + (ny * width + nx) * 2; \
+				const s32 dx = n[0] + (ox), dy = n[1] + (oy); \
+				if (dx * dx + dy * dy < c[0] * c[0] + c[1] * c[1]) { c[0] = dx; c[1] = dy; } \
+			} \
+		}
+
+		for (s32 y = 0; y < rows; ++y)
 		{
-			bool lineBreak=false;
-			if (currentChar == L'\r') // Mac or Windows breaks
-			{
-				lineBreak = true;
-				if (*(iter + 1) == (uchar32_t)'\n')	// Windows line breaks.
-					currentChar = *(++iter);
-			}
-			else if (currentChar == (uchar32_t)'\n') // Unix breaks
+			for (s32 x = 0; x < width; ++x)
 			{
-				lineBreak = true;
+				CGUITT_EDT_COMPARE(-1, 0);
+				CGUITT_EDT_COMPARE(0, -1);
+				CGUITT_EDT_COMPARE(-1, -1);
+				CGUITT_EDT_COMPARE(1, -1);
 			}
-
-			if (lineBreak)
+			for (s32 x = width - 1; x >= 0; --x)
+				CGUITT_EDT_COMPARE(1, 0);
+		}
+		for (s32 y = rows - 1; y >= 0; --y)
+		{
+			for (s32 x = width - 1; x >= 0; --x)
 			{
-				previousChar = 0;
-				offset.Y += font_metrics.ascender / 64;
-				offset.X = position.UpperLeftCorner.X;
-
-				if (hcenter)
-					offset.X += (position.getWidth() - textDimension.Width) >> 1;
-				++iter;
-				continue;
+				CGUITT_EDT_COMPARE(1, 0);
+				CGUITT_EDT_COMPARE(0, 1);
+				CGUITT_EDT_COMPARE(-1, 1);
+				CGUITT_EDT_COMPARE(1, 1);
 			}
-
-			// Calculate the glyph offset.
-			s32 offx = Glyphs[n-1].offset.X;
-			s32 offy = (font_metrics.ascender / 64) - Glyphs[n-1].offset.Y;
-
-			// Apply kerning.
-			core::vector2di k = getKerning(currentChar, previousChar);
-			offset.X += k.X;
-			offset.Y += k.Y;
-
-			// Determine rendering information.
-			SGUITTGlyph& glyph = Glyphs[n-1];
-			CGUITTGlyphPage* const page = Glyph_Pages[glyph.glyph_page];
-			page->render_positions.push_back(core::position2di(offset.X + offx, offset.Y + offy));
-			page->render_source_rects.push_back(glyph.source_rect);
-			Render_Map.set(glyph.glyph_page, page);
+			for (s32 x = 0; x < width; ++x)
+				CGUITT_EDT_COMPARE(-1, 0);
 		}
-		offset.X += getWidthFromCharacter(currentChar);
-
-		previousChar = currentChar;
-		++iter;
+		#undef CGUITT_EDT_COMPARE
 	}
 
-	// Draw now.
-	update_glyph_pages();
-	core::map<u32, CGUITTGlyphPage*>::Iterator j = Render_Map.getIterator();
-	while (!j.atEnd())
+	// Signed distance to the outline, positive outside.  The half pixel moves it from pixel centers to
+	// the pixel edge, and partly covered pixels use their coverage for a closer estimate.
+	// Inside maps above 128, outside below, and the spread reaches 0 and 255.
+	const f32 to_value = 128.f / spread;
+	for (s32 i = 0; i < cells; ++i)
 	{
-		core::map<u32, CGUITTGlyphPage*>::Node* n = j.getNode();
-		j++;
-		if (n == 0) continue;
+		f32 distance;
+		if (coverage[i] > 0 && coverage[i] < 255)
+			distance = 0.5f - coverage[i] / 255.f;
+		else
+		{
+			const s32* outside = grids[0] + i * 2;
+			const s32* inside = grids[1] + i * 2;
+			if (coverage[i] >= 128)
+				distance = 0.5f - core::squareroot((f32)(inside[0] * inside[0] + inside[1] * inside[1]));
+			else distance = core::squareroot((f32)(outside[0] * outside[0] + outside[1] * outside[1])) - 0.5f;
+		}
+		coverage[i] = (u8)core::clamp(128.f - distance * to_value, 0.f, 255.f);
+	}
 
-		CGUITTGlyphPage* page = n->getValue();
+	memset(&out, 0, sizeof(FT_Bitmap));
+	out.width = width;
+	out.rows = rows;
+	out.pitch = width;
+	out.buffer = coverage;
+	out.num_grays = 256;
+	out.pixel_mode = FT_PIXEL_MODE_GRAY;
+}
 
-		if (!use_transparency) color.color |= 0xff000000;
-		Driver->draw2DImageBatch(page->texture, page->render_positions, page->render_source_rects, clip, color, true);
-	}
+IGUIFont* CGUITTFont::createScaledFont(u32 display_size)
+{
+	return new CGUITTScaledFont(this, (f32)display_size / size);
 }
 
 core::dimension2d<u32> CGUITTFont::getCharDimension(const wchar_t ch) const
@@ -636,11 +2203,67 @@ core::dimension2d<u32> CGUITTFont::getCharDimension(const wchar_t ch) const
 
 core::dimension2d<u32> CGUITTFont::getDimension(const wchar_t* text) const
 {
-	return getDimension(core::ustring(text));
+	u64 key;
+	const SGUITTTextLayout* layout = findTextLayout(text, 0, 0, false, false, 0, key);
+	if (layout && !layout->pending)
+	{
+		++Layout_Cache_Hits;
+		return layout->dimension;
+	}
+	++Layout_Cache_Misses;
+
+	const u32 pending_lookups = Pending_Lookups;
+	const core::dimension2d<u32> dimension = measureText(text);
+
+	// Measurements made with stand-in glyphs are only good until the real ones arrive.
+	if (layout || Pending_Lookups != pending_lookups)
+		return dimension;
+
+	// Remember the dimension.  A draw() of the same text fills in the rest of the layout.
+	SGUITTTextLayout* added = addTextLayout(text, 0, 0, false, false, 0, key);
+	if (added)
+		added->dimension = dimension;
+	return dimension;
 }
 
 core::dimension2d<u32> CGUITTFont::getDimension(const core::ustring& text) const
 {
+	return measureText(text.toWCHAR_s().c_str());
+}
+
+core::dimension2d<u32> CGUITTFont::getWrappedDimension(const wchar_t* text, s32 wrap_width) const
+{
+	if (wrap_width <= 0)
+		return getDimension(text);
+
+	// Shares the layout cache entry of a drawWrapped() that doesn't center.
+	u64 key;
+	const SGUITTTextLayout* layout = findTextLayout(text, 0, 0, false, false, wrap_width, key);
+	if (layout && !layout->pending)
+	{
+		++Layout_Cache_Hits;
+		return layout->dimension;
+	}
+	++Layout_Cache_Misses;
+
+	const u32 pending_lookups = Pending_Lookups;
+	break_lines(text, wrap_width, Wrap_Lines);
+	const core::dimension2d<u32> dimension = measure_lines(Wrap_Lines);
+
+	if (layout || Pending_Lookups != pending_lookups)
+		return dimension;
+
+	SGUITTTextLayout* added = addTextLayout(text, 0, 0, false, false, wrap_width, key);
+	if (added)
+		added->dimension = dimension;
+	return dimension;
+}
+
+s32 CGUITTFont::get_line_height() const
+{
+	if (Vertical_Metrics.line_height > 0)
+		return Vertical_Metrics.line_height;
+
 	// Get the maximum font height.  Unfortunately, we have to do this hack as
 	// Irrlicht will draw things wrong.  In FreeType, the font size is the
 	// maximum size for a single glyph, but that glyph may hang "under" the
@@ -648,28 +2271,36 @@ core::dimension2d<u32> CGUITTFont::getDimension(const core::ustring& text) const
 	// Irrlicht does not understand this concept when drawing fonts.  Also, I
 	// add +1 to give it a 1 pixel blank border.  This makes things like
 	// tooltips look nicer.
+	const u32 pending_lookups = Pending_Lookups;
 	s32 test1 = getHeightFromCharacter((uchar32_t)'g') + 1;
 	s32 test2 = getHeightFromCharacter((uchar32_t)'j') + 1;
 	s32 test3 = getHeightFromCharacter((uchar32_t)'_') + 1;
 	s32 max_font_height = core::max_(test1, core::max_(test2, test3));
 
+	// Heights of stand-in glyphs are only good until the real ones arrive.
+	if (Pending_Lookups == pending_lookups)
+		Vertical_Metrics.line_height = max_font_height;
+	return max_font_height;
+}
+
+core::dimension2d<u32> CGUITTFont::measureText(const wchar_t* text) const
+{
+	const s32 max_font_height = get_line_height();
+
 	core::dimension2d<u32> text_dimension(0, max_font_height);
 	core::dimension2d<u32> line(0, max_font_height);
 
 	uchar32_t previousChar = 0;
-	core::ustring::const_iterator iter = text.begin();
-	for (; !iter.atEnd(); ++iter)
+	const wchar_t* iter = text;
+	while (*iter)
 	{
-		uchar32_t p = *iter;
+		uchar32_t p = readWideChar(iter);
 		bool lineBreak = false;
 		if (p == '\r')	// Mac or Windows line breaks.
 		{
 			lineBreak = true;
-			if (*(iter + 1) == '\n')
-			{
-				++iter;
-				p = *iter;
-			}
+			if (*iter == L'\n')
+				p = (uchar32_t)*iter++;
 		}
 		else if (p == '\n')	// Unix line breaks.
 		{
@@ -700,139 +2331,554 @@ core::dimension2d<u32> CGUITTFont::getDimension(const core::ustring& text) const
 	return text_dimension;
 }
 
-inline u32 CGUITTFont::getWidthFromCharacter(wchar_t c) const
+void CGUITTFont::break_lines(const wchar_t* text, s32 wrap_width, core::array<SGUITTTextLayout::SLine>& lines) const
+{
+	lines.set_used(0);
+
+	SGUITTTextLayout::SLine line;
+	line.begin = 0;
+
+	// The pen position, and the end of the line without trailing spaces.
+	s32 x = 0;
+	s32 content_x = 0;
+	u32 content_end = 0;
+
+	// The last place on the line it can wrap at: where the next line would start, the pen position
+	// and kerning there, and where this line would end.
+	bool has_break = false;
+	u32 break_begin = 0;
+	s32 break_x = 0;
+	s32 break_kern = 0;
+	u32 break_end = 0;
+	s32 break_width = 0;
+
+	uchar32_t previousChar = 0;
+	const wchar_t* p = text;
+	while (*p)
+	{
+		const u32 pos = (u32)(p - text);
+		const uchar32_t c = readWideChar(p);
+
+		// Line breaks end the line whatever its width.
+		if (c == '\r' || c == '\n')
+		{
+			line.end = wrap_width > 0 ? content_end : pos;
+			line.width = wrap_width > 0 ? content_x : x;
+			lines.push_back(line);
+
+			if (c == '\r' && *p == L'\n')	// Windows line breaks.
+				++p;
+			line.begin = content_end = (u32)(p - text);
+			x = content_x = 0;
+			has_break = false;
+			previousChar = 0;
+			continue;
+		}
+
+		s32 kern = getKerning(c, previousChar).X;
+		const s32 advance = (s32)getWidthFromCharacter(c);
+
+		if (wrap_width > 0 && pos > line.begin)
+		{
+			if (canWrapBetween(previousChar, c))
+			{
+				has_break = true;
+				break_begin = pos;
+				break_x = x;
+				break_kern = kern;
+				break_end = content_end;
+				break_width = content_x;
+			}
+
+			// Spaces hang past the edge.  Anything else that doesn't fit goes on the next line.
+			while (!isWrapSpace(c) && pos > line.begin && x + kern + advance > wrap_width)
+			{
+				if (has_break)
+				{
+					line.end = break_end;
+					line.width = break_width;
+					lines.push_back(line);
+
+					// What followed the break moves over, minus the kerning against the previous line.
+					line.begin = break_begin;
+					x -= break_x + break_kern;
+					content_x -= break_x + break_kern;
+					has_break = false;
+				}
+				else
+				{
+					// A word wider than the line is broken where it overflows.
+					line.end = content_end;
+					line.width = content_x;
+					lines.push_back(line);
+
+					line.begin = content_end = pos;
+					x = content_x = 0;
+					kern = 0;
+				}
+			}
+		}
+
+		x += kern + advance;
+		if (!isWrapSpace(c))
+		{
+			content_x = x;
+			content_end = (u32)(p - text);
+		}
+		previousChar = c;
+	}
+
+	line.end = wrap_width > 0 ? content_end : (u32)(p - text);
+	line.width = wrap_width > 0 ? content_x : x;
+	lines.push_back(line);
+}
+
+core::dimension2d<u32> CGUITTFont::measure_lines(const core::array<SGUITTTextLayout::SLine>& lines) const
+{
+	core::dimension2d<u32> dimension(0, lines.size() * get_line_height());
+	for (u32 i = 0; i < lines.size(); ++i)
+		dimension.Width = core::max_(dimension.Width, (u32)core::max_(lines[i].width, 0));
+	return dimension;
+}
+
+inline u32 CGUITTFont::getWidthFromCharacter(wchar_t c) const
+{
+	return getWidthFromCharacter((uchar32_t)c);
+}
+
+inline u32 CGUITTFont::getWidthFromCharacter(uchar32_t c) const
+{
+	// Set the size of the face.
+	// This is because we cache faces and the face may have been set to a different size.
+	//FT_Set_Pixel_Sizes(tt_face, 0, size);
+
+	u32 n = getGlyphIndexByChar(c);
+	if (n > 0)
+	{
+		return get_table(n).getAdvance(table_index(n));
+	}
+	if (c >= 0x2000)
+		return Vertical_Metrics.ascender;
+	else return Vertical_Metrics.ascender / 2;
+}
+
+inline u32 CGUITTFont::getHeightFromCharacter(wchar_t c) const
+{
+	return getHeightFromCharacter((uchar32_t)c);
+}
+
+inline u32 CGUITTFont::getHeightFromCharacter(uchar32_t c) const
+{
+	// Set the size of the face.
+	// This is because we cache faces and the face may have been set to a different size.
+	//FT_Set_Pixel_Sizes(tt_face, 0, size);
+
+	u32 n = getGlyphIndexByChar(c);
+	if (n > 0)
+	{
+		// Grab the true height of the character, taking into account underhanging glyphs.
+		const CGUITTGlyphTable& glyphs = get_table(n);
+		const u32 index = table_index(n);
+		const core::recti source_rect = glyphs.getSourceRect(index);
+		s32 height = Vertical_Metrics.ascender - glyphs.getOffset(index).Y + source_rect.getHeight();
+
+		// Don't count the distance field margin below the glyph.  Empty glyphs, like spaces, don't get one.
+		if (source_rect.getWidth() > 0 && source_rect.getHeight() > 0)
+			height -= Distance_Field_Spread;
+		return height;
+	}
+	if (c >= 0x2000)
+		return Vertical_Metrics.ascender;
+	else return Vertical_Metrics.ascender / 2;
+}
+
+u32 CGUITTFont::getGlyphIndexByChar(wchar_t c) const
+{
+	return getGlyphIndexByChar((uchar32_t)c);
+}
+
+u32 CGUITTFont::getCachedCharIndex(uchar32_t c) const
+{
+	// Look in the cache first.
+	u32* cached = 0;
+	if (c < CHAR_INDEX_TABLE_SIZE)
+	{
+		if (Char_Index_Table.empty())
+		{
+			Char_Index_Table.reallocate(CHAR_INDEX_TABLE_SIZE);
+			Char_Index_Table.set_used(CHAR_INDEX_TABLE_SIZE);
+			for (u32 i = 0; i < CHAR_INDEX_TABLE_SIZE; ++i)
+				Char_Index_Table[i] = CHAR_INDEX_UNKNOWN;
+		}
+		cached = &Char_Index_Table[c];
+		if (*cached != CHAR_INDEX_UNKNOWN)
+			return *cached;
+	}
+	else if ((cached = Char_Index_Map.find(c)) != 0)
+		return *cached;
+
+	// Get the glyph. Changed from "glyph" to "glyph_idx" by chronologicaldot to remove ambiguity
+	u32 glyph_idx = FT_Get_Char_Index(tt_face, c);
+
+	// Walk the fallback chain for characters we don't have.  The answer is cached with the rest,
+	// so the walk only happens once per character.
+	for (u32 i = 0; glyph_idx == 0 && i < Fallback_Faces.size(); ++i)
+	{
+		const u32 fallback_idx = FT_Get_Char_Index(Fallback_Faces[i]->face, c);
+		if (fallback_idx != 0)
+			glyph_idx = ((i + 1) << GLYPH_SLOT_SHIFT) | fallback_idx;
+	}
+
+	// Check for a valid glyph.  If it is invalid, attempt to use the replacement character.
+	if (glyph_idx == 0)
+		glyph_idx = FT_Get_Char_Index(tt_face, core::unicode::UTF_REPLACEMENT_CHARACTER);
+
+	if (c < CHAR_INDEX_TABLE_SIZE)
+		*cached = glyph_idx;
+	else Char_Index_Map.set(c, glyph_idx);
+
+	return glyph_idx;
+}
+
+u32 CGUITTFont::getGlyphIndexByChar(uchar32_t c) const
+{
+	u32 glyph_idx = getCachedCharIndex(c);
+
+	// If our glyph is already loaded, don't bother doing any batch loading code.
+	if (glyph_idx != 0 && get_glyph(glyph_idx).isLoaded)
+	{
+		get_glyph(glyph_idx).touch(Frame);
+		return glyph_idx;
+	}
+
+	// Already queued for background loading.
+	if (glyph_idx != 0 && get_glyph(glyph_idx).isPending)
+	{
+		if (Async_Loading)
+			return pending_stand_in();
+
+		// Queued by a background preload.  Rather than wait for the rest of the queue, render it here.
+		// commit_glyph() ignores the copy from the rasterizer.
+		SGUITTGlyph& glyph = get_glyph(glyph_idx);
+		glyph.isPending = false;
+		--Async_Pending;
+		load_glyph(glyph_idx);
+		glyph.touch(Frame);
+		return glyph_idx;
+	}
+
+	// Determine our batch loading positions.
+	u32 half_size = (batch_load_size / 2);
+	u32 start_pos = 0;
+	if (c > half_size) start_pos = c - half_size;
+	u32 end_pos = start_pos + batch_load_size;
+
+	// Find the glyphs that haven't been loaded yet.
+	// Neighbouring characters can share a glyph (such as the replacement character), so only list each once.
+	// The rasterizer threads only have our own face, so glyphs from fallback faces are loaded right here.
+	core::array<u32> batch;
+	do
+	{
+		u32 char_index = getCachedCharIndex(start_pos);
+		if (char_index == 0)
+			continue;
+
+		const SGUITTGlyph& glyph = get_glyph(char_index);
+		if (glyph.isLoaded || glyph.isPending)
+			continue;
+
+		if (char_index >> GLYPH_SLOT_SHIFT)
+			load_glyph(char_index);
+		else if (batch.linear_search(char_index) == -1)
+			batch.push_back(char_index);
+	}
+	while (++start_pos < end_pos);
+
+	if (Async_Loading && Rasterizer)
+	{
+		// Queue the glyphs and carry on.  draw() picks them up when they are done.
+		for (u32 i = 0; i < batch.size(); ++i)
+		{
+			Glyphs[batch[i] - 1].isPending = true;
+			Rasterizer->enqueue(batch[i], load_flags);
+		}
+		Async_Pending += batch.size();
+
+		if (glyph_idx != 0 && get_glyph(glyph_idx).isPending)
+			return pending_stand_in();
+	}
+	else if (Rasterizer && batch.size() >= RASTERIZER_MIN_BATCH)
+	{
+		// Render the bitmaps in parallel, then place them on the pages here.
+		core::array<SGUITTRasterizedGlyph> rendered;
+		Rasterizer->rasterize(batch, load_flags, rendered);
+		for (u32 i = 0; i < rendered.size(); ++i)
+			commit_glyph(rendered[i]);
+	}
+	else
+	{
+		for (u32 i = 0; i < batch.size(); ++i)
+			load_glyph(batch[i]);
+	}
+
+	// Return our original character.
+	if (glyph_idx != 0)
+		get_glyph(glyph_idx).touch(Frame);
+	return glyph_idx;
+}
+
+CGUITTGlyphTable& CGUITTFont::get_table(u32 handle) const
+{
+	const u32 slot = handle >> GLYPH_SLOT_SHIFT;
+	return slot ? Fallback_Faces[slot - 1]->glyphs : Glyphs;
+}
+
+SGUITTGlyph& CGUITTFont::get_glyph(u32 handle) const
+{
+	return get_table(handle)[table_index(handle)];
+}
+
+FT_Face CGUITTFont::get_face(u32 handle) const
+{
+	const u32 slot = handle >> GLYPH_SLOT_SHIFT;
+	return slot ? Fallback_Faces[slot - 1]->face : tt_face;
+}
+
+FT_Size CGUITTFont::get_size(u32 handle) const
+{
+	const u32 slot = handle >> GLYPH_SLOT_SHIFT;
+	return slot ? Fallback_Faces[slot - 1]->size : tt_size;
+}
+
+void CGUITTFont::load_glyph(u32 handle) const
 {
-	return getWidthFromCharacter((uchar32_t)c);
+	if (get_glyph(handle).isLoaded)
+		return;
+
+	// Set the size of the glyph.  The face may be shared with fonts of other sizes.
+	FT_Size face_size = get_size(handle);
+	FT_Activate_Size(face_size);
+	FT_Face face = face_size->face;
+
+	// Attempt to load the glyph.
+	if (FT_Load_Glyph(face, handle & GLYPH_INDEX_MASK, load_flags) != FT_Err_Ok)
+		// TODO: error message?
+		return;
+
+	FT_GlyphSlot slot = face->glyph;
+	place_glyph(handle, slot->bitmap, slot->advance.x / 64, slot->bitmap_left, slot->bitmap_top);
 }
 
-inline u32 CGUITTFont::getWidthFromCharacter(uchar32_t c) const
+void CGUITTFont::place_glyph(u32 handle, const FT_Bitmap& bits, s32 advance, s32 left, s32 top) const
 {
-	// Set the size of the face.
-	// This is because we cache faces and the face may have been set to a different size.
-	//FT_Set_Pixel_Sizes(tt_face, 0, size);
+	SGUITTGlyph& glyph = get_glyph(handle);
+	if (glyph.isLoaded)
+		return;
 
-	u32 n = getGlyphIndexByChar(c);
-	if (n > 0)
+	// Glyphs are loaded on demand by const lookups, the same reason the glyph pages are mutable.
+	CGUITTFont* self = const_cast<CGUITTFont*>(this);
+
+	// Distance field glyphs carry a margin around the outline for the field to fade out in.
+	core::vector2di offset(left, top);
+	const FT_Bitmap* bitmap = &bits;
+	FT_Bitmap field;
+	if (Distance_Field_Spread > 0 && bits.width > 0 && bits.rows > 0)
 	{
-		int w = Glyphs[n-1].advance.x / 64;
-		return w;
+		self->makeDistanceField(bits, field);
+		offset.X -= Distance_Field_Spread;
+		offset.Y += Distance_Field_Spread;
+		bitmap = &field;
 	}
-	if (c >= 0x2000)
-		return (font_metrics.ascender / 64);
-	else return (font_metrics.ascender / 64) / 2;
+
+	CGUITTGlyphTable& glyphs = get_table(handle);
+	const u32 index = table_index(handle);
+	glyphs.setMetrics(index, advance, offset);
+
+	// Find room for the glyph on a page, making a new page if we have to.
+	core::recti source_rect;
+	u32 page_index;
+	CGUITTGlyphPage* page = self->allocateGlyphRect(core::dimension2du(bitmap->width, bitmap->rows), bitmap->pixel_mode, source_rect, page_index);
+	if (!page)
+		// TODO: add error message?
+		return;
+
+	// Copy the bitmap out now, before the next glyph load overwrites it.
+	// The page textures are only updated right before the batch draw call.
+	page->writeGlyph(*bitmap, source_rect.UpperLeftCorner);
+	glyphs.setPlacement(index, page_index, source_rect);
+
+	// Set our glyph as loaded.
+	glyph.isLoaded = true;
 }
 
-inline u32 CGUITTFont::getHeightFromCharacter(wchar_t c) const
+bool CGUITTFont::addFallbackFont(const io::path& filename)
 {
-	return getHeightFromCharacter((uchar32_t)c);
+	if (!tt_face || Fallback_Faces.size() >= 255)
+		return false;
+
+	io::IFileSystem* filesystem = Environment ? Environment->getFileSystem() : 0;
+	irr::ILogger* logger = (Device != 0 ? Device->getLogger() : 0);
+	SGUITTFace* face = grab_face(filename, filesystem, logger);
+	if (!face)
+		return false;
+
+	FT_Size face_size = face->grabSize(size);
+	if (!face_size)
+	{
+		drop_face(filename, 0);
+		return false;
+	}
+
+	SFallbackFace* fallback = new SFallbackFace();
+	fallback->filename = filename;
+	fallback->face = face->face;
+	fallback->size = face_size;
+	fallback->glyphs.resize(face->face->num_glyphs);
+	Fallback_Faces.push_back(fallback);
+
+	// Characters that used to get the replacement character may be in the new face.
+	Char_Index_Table.clear();
+	Char_Index_Map.clear();
+	Vertical_Metrics.line_height = 0;
+	clearLayoutCache();
+	return true;
 }
 
-inline u32 CGUITTFont::getHeightFromCharacter(uchar32_t c) const
+void CGUITTFont::clearFallbackFonts()
 {
-	// Set the size of the face.
-	// This is because we cache faces and the face may have been set to a different size.
-	//FT_Set_Pixel_Sizes(tt_face, 0, size);
+	if (Fallback_Faces.empty())
+		return;
 
-	u32 n = getGlyphIndexByChar(c);
-	if (n > 0)
+	// Their glyphs are scattered over our pages, so start the pages over.
+	reset_images();
+	for (u32 i = 0; i < Fallback_Faces.size(); ++i)
 	{
-		// Grab the true height of the character, taking into account underhanging glyphs.
-		s32 height = (font_metrics.ascender / 64) - Glyphs[n-1].offset.Y + Glyphs[n-1].source_rect.getHeight();
-		return height;
+		drop_face(Fallback_Faces[i]->filename, Fallback_Faces[i]->size);
+		delete Fallback_Faces[i];
 	}
-	if (c >= 0x2000)
-		return (font_metrics.ascender / 64);
-	else return (font_metrics.ascender / 64) / 2;
+	Fallback_Faces.clear();
+
+	// Glyph handles carry the fallback slot, so anything cached by handle would point at the
+	// faces of the next addFallbackFont() calls.
+	Char_Index_Table.clear();
+	Char_Index_Map.clear();
+	Kerning_Cache.clear();
+	Vertical_Metrics.line_height = 0;
+	clearLayoutCache();
 }
 
-u32 CGUITTFont::getGlyphIndexByChar(wchar_t c) const
+s32 CGUITTFont::getCharacterFromPos(const wchar_t* text, s32 pixel_x) const
 {
-	return getGlyphIndexByChar((uchar32_t)c);
+	return getCharacterFromPos(get_advances(text), pixel_x);
 }
 
-u32 CGUITTFont::getGlyphIndexByChar(uchar32_t c) const
+s32 CGUITTFont::getCharacterFromPos(const core::ustring& text, s32 pixel_x) const
 {
-	// Get the glyph. Changed from "glyph" to "glyph_idx" by chronologicaldot to remove ambiguity
-	u32 glyph_idx = FT_Get_Char_Index(tt_face, c);
-
-	// Check for a valid glyph.  If it is invalid, attempt to use the replacement character.
-	if (glyph_idx == 0)
-		glyph_idx = FT_Get_Char_Index(tt_face, core::unicode::UTF_REPLACEMENT_CHARACTER);
+	return getCharacterFromPos(text.toWCHAR_s().c_str(), pixel_x);
+}
 
-	// If our glyph is already loaded, don't bother doing any batch loading code.
-	if (glyph_idx != 0 && Glyphs[glyph_idx - 1].isLoaded)
-		return glyph_idx;
+s32 CGUITTFont::getCaretPosition(const wchar_t* text, u32 index) const
+{
+	return getCaretPosition(get_advances(text), index);
+}
 
-	// Determine our batch loading positions.
-	u32 half_size = (batch_load_size / 2);
-	u32 start_pos = 0;
-	if (c > half_size) start_pos = c - half_size;
-	u32 end_pos = start_pos + batch_load_size;
+bool CGUITTFont::getCharacterPositions(const wchar_t* text, SGUITTTextLayout& layout) const
+{
+	layout.text = text;
+	return measure_advances(text, layout);
+}
 
-	// Load all our characters.
-	do
+s32 CGUITTFont::getCharacterFromPos(const SGUITTTextLayout& layout, s32 pixel_x) const
+{
+	// Find the first character whose end reaches pixel_x.  Negative kerning can move the pen back,
+	// so search the running maximum of the ends rather than the ends themselves.
+	const core::array<s32>& ends = layout.advance_max;
+	u32 low = 0;
+	u32 high = ends.size();
+	while (low < high)
 	{
-		// Get the character we are going to load.
-		u32 char_index = FT_Get_Char_Index(tt_face, start_pos);
-
-		// If the glyph hasn't been loaded yet, do it now.
-		if (char_index)
-		{
-			SGUITTGlyph& glyph = Glyphs[char_index - 1];
-			if (!glyph.isLoaded)
-			{
-				glyph.preload(char_index, tt_face, Driver, size, load_flags);
-				Glyph_Pages[glyph.glyph_page]->pushGlyphToBePaged(&glyph);
-			}
-		}
+		const u32 mid = (low + high) / 2;
+		if (ends[mid] >= pixel_x)
+			high = mid;
+		else low = mid + 1;
 	}
-	while (++start_pos < end_pos);
+	return low < ends.size() ? (s32)low : -1;
+}
 
-	// Return our original character.
-	return glyph_idx;
+s32 CGUITTFont::getCaretPosition(const SGUITTTextLayout& layout, u32 index) const
+{
+	const core::array<s32>& advances = layout.advances;
+	if (index == 0 || advances.empty())
+		return 0;
+	return advances[core::min_(index, advances.size()) - 1];
 }
 
-s32 CGUITTFont::getCharacterFromPos(const wchar_t* text, s32 pixel_x) const
+const SGUITTTextLayout& CGUITTFont::get_advances(const wchar_t* text) const
 {
-	return getCharacterFromPos(core::ustring(text), pixel_x);
+	// Hit-testing shares the layout cache entry of getDimension().
+	u64 key;
+	SGUITTTextLayout* layout = findTextLayout(text, 0, 0, false, false, 0, key);
+	if (layout && layout->has_advances)
+		return *layout;
+
+	// Positions measured with stand-in glyphs are only good until the real ones arrive.
+	SGUITTTextLayout& measured = Hit_Test_Layout;
+	if (!measure_advances(text, measured))
+		return measured;
+
+	if (!layout)
+	{
+		// Cached layouts always know their dimension.
+		layout = addTextLayout(text, 0, 0, false, false, 0, key);
+		if (!layout)
+			return measured;
+		layout->dimension = measureText(text);
+	}
+
+	// Trade arrays with the scratch layout, so neither has to allocate next time.
+	layout->advances.swap(measured.advances);
+	layout->advance_max.swap(measured.advance_max);
+	layout->has_advances = true;
+	measured.has_advances = false;
+	return *layout;
 }
 
-s32 CGUITTFont::getCharacterFromPos(const core::ustring& text, s32 pixel_x) const
+bool CGUITTFont::measure_advances(const wchar_t* text, SGUITTTextLayout& layout) const
 {
-	s32 x = 0;
-	//s32 idx = 0;
+	layout.advances.set_used(0);
+	layout.advance_max.set_used(0);
 
-	u32 character = 0;
+	const u32 pending_lookups = Pending_Lookups;
+	s32 x = 0;
 	uchar32_t previousChar = 0;
-	core::ustring::const_iterator iter = text.begin();
-	while (!iter.atEnd())
+	const wchar_t* iter = text;
+	while (*iter)
 	{
-		uchar32_t c = *iter;
+		const uchar32_t c = readWideChar(iter);
 		x += getWidthFromCharacter(c);
 
 		// Kerning.
-		core::vector2di k = getKerning(c, previousChar);
-		x += k.X;
-
-		if (x >= pixel_x)
-			return character;
-
+		x += getKerning(c, previousChar).X;
 		previousChar = c;
-		++iter;
-		++character;
+
+		layout.advances.push_back(x);
+		layout.advance_max.push_back(layout.advance_max.empty() ? x : core::max_(x, layout.advance_max.getLast()));
 	}
 
-	return -1;
+	layout.has_advances = true;
+	return Pending_Lookups == pending_lookups;
 }
 
 void CGUITTFont::setKerningWidth(s32 kerning)
 {
 	GlobalKerningWidth = kerning;
+	clearLayoutCache();
 }
 
 void CGUITTFont::setKerningHeight(s32 kerning)
 {
 	GlobalKerningHeight = kerning;
+	clearLayoutCache();
 }
 
 s32 CGUITTFont::getKerningWidth(const wchar_t* thisLetter, const wchar_t* previousLetter) const
@@ -867,72 +2913,369 @@ core::vector2di CGUITTFont::getKerning(const uchar32_t thisLetter, const uchar32
 	if (tt_face == 0 || thisLetter == 0 || previousLetter == 0)
 		return core::vector2di();
 
-	// Set the size of the face.
-	// This is because we cache faces and the face may have been set to a different size.
-	FT_Set_Pixel_Sizes(tt_face, 0, size);
-
 	core::vector2di ret(GlobalKerningWidth, GlobalKerningHeight);
 
 	// If we don't have kerning, no point in continuing.
-	if (!FT_HAS_KERNING(tt_face))
+	if (!FT_HAS_KERNING(tt_face) && Fallback_Faces.empty())
 		return ret;
 
+	// Kerning only needs the glyph indices, not the loaded glyphs.
+	ret += getGlyphKerning(getCachedCharIndex(thisLetter), getCachedCharIndex(previousLetter));
+	return ret;
+}
+
+core::vector2di CGUITTFont::getGlyphKerning(const u32 thisGlyph, const u32 previousGlyph) const
+{
+	// Glyphs from different faces don't kern against each other.
+	FT_Face face = get_face(thisGlyph);
+	if (face != get_face(previousGlyph) || !FT_HAS_KERNING(face))
+		return core::vector2di();
+
+	const u64 key = ((u64)previousGlyph << 32) | thisGlyph;
+	const core::vector2di* cached = Kerning_Cache.find(key);
+	if (cached)
+		return *cached;
+
+	// The face is shared with fonts of other sizes, so switch to ours.
+	FT_Activate_Size(get_size(thisGlyph));
+
 	// Get the kerning information.
 	FT_Vector v;
-	FT_Get_Kerning(tt_face, getGlyphIndexByChar(previousLetter), getGlyphIndexByChar(thisLetter), FT_KERNING_DEFAULT, &v);
+	if (FT_Get_Kerning(face, previousGlyph & GLYPH_INDEX_MASK, thisGlyph & GLYPH_INDEX_MASK, FT_KERNING_DEFAULT, &v) != FT_Err_Ok)
+		v.x = v.y = 0;
 
 	// If we have a scalable font, the return value will be in font points.
-	if (FT_IS_SCALABLE(tt_face))
+	core::vector2di ret;
+	if (FT_IS_SCALABLE(face))
 	{
 		// Font points, so divide by 64.
-		ret.X += (v.x / 64);
-		ret.Y += (v.y / 64);
+		ret.X = (v.x / 64);
+		ret.Y = (v.y / 64);
 	}
 	else
 	{
 		// Pixel units.
-		ret.X += v.x;
-		ret.Y += v.y;
+		ret.X = v.x;
+		ret.Y = v.y;
 	}
-	return ret;
+
+	return Kerning_Cache.set(key, ret);
+}
+
+void CGUITTFont::preloadKerning(const uchar32_t first, const uchar32_t last)
+{
+	if (tt_face == 0 || !FT_HAS_KERNING(tt_face) || last < first)
+		return;
+
+	// Collect the glyphs once, skipping characters the font doesn't have.
+	core::array<u32> glyphs(last - first + 1);
+	for (uchar32_t c = first; c <= last; ++c)
+	{
+		const u32 glyph_idx = FT_Get_Char_Index(tt_face, c);
+		if (glyph_idx != 0)
+			glyphs.push_back(glyph_idx);
+	}
+
+	for (u32 i = 0; i < glyphs.size(); ++i)
+		for (u32 j = 0; j < glyphs.size(); ++j)
+			getGlyphKerning(glyphs[j], glyphs[i]);
+}
+
+u32 CGUITTFont::preload_glyphs(const core::array<uchar32_t>& chars, bool background)
+{
+	if (tt_face == 0)
+		return 0;
+
+	if (background && Rasterizer_Threads == 0)
+		setRasterizerThreadCount(1);
+	background = background && Rasterizer != 0;
+
+	// Preloaded glyphs count as used now, so a page budget doesn't throw them away first, but they
+	// don't add to the use count written to manifests.
+	// The rasterizer threads only have our own face, so glyphs from fallback faces are loaded right here.
+	core::array<u32> batch;
+	u32 queued = 0;
+	for (u32 i = 0; i < chars.size(); ++i)
+	{
+		const u32 idx = getCachedCharIndex(chars[i]);
+		if (idx == 0)
+			continue;
+
+		SGUITTGlyph& glyph = get_glyph(idx);
+		if (glyph.isLoaded || glyph.isPending)
+			continue;
+
+		glyph.last_used = Frame;
+		if (idx >> GLYPH_SLOT_SHIFT)
+		{
+			load_glyph(idx);
+			++queued;
+		}
+		else if (background)
+		{
+			// Being pending also keeps the glyph from being queued twice.
+			glyph.isPending = true;
+			Rasterizer->enqueue(idx, load_flags);
+			++Async_Pending;
+			++queued;
+		}
+		else batch.push_back(idx);
+	}
+
+	if (batch.empty())
+		return queued;
+
+	// Characters can share a glyph, so list each one once.
+	batch.sort();
+	u32 unique = 1;
+	for (u32 i = 1; i < batch.size(); ++i)
+	{
+		if (batch[i] != batch[unique - 1])
+			batch[unique++] = batch[i];
+	}
+	batch.set_used(unique);
+
+	if (Rasterizer && batch.size() >= RASTERIZER_MIN_BATCH)
+	{
+		core::array<SGUITTRasterizedGlyph> rendered;
+		Rasterizer->rasterize(batch, load_flags, rendered);
+		for (u32 i = 0; i < rendered.size(); ++i)
+			commit_glyph(rendered[i]);
+	}
+	else
+	{
+		for (u32 i = 0; i < batch.size(); ++i)
+			load_glyph(batch[i]);
+	}
+	return queued + batch.size();
+}
+
+u32 CGUITTFont::preloadGlyphs(const core::ustring& text, bool background)
+{
+	core::array<uchar32_t> chars(text.size());
+	core::ustring::const_iterator iter = text.begin();
+	while (!iter.atEnd())
+	{
+		chars.push_back(*iter);
+		++iter;
+	}
+	return preload_glyphs(chars, background);
+}
+
+u32 CGUITTFont::preloadGlyphs(const core::array<SGUITTCharRange>& ranges, bool background)
+{
+	core::array<uchar32_t> chars;
+	for (u32 i = 0; i < ranges.size(); ++i)
+	{
+		for (uchar32_t c = ranges[i].first; c <= ranges[i].last && c <= 0x10FFFF; ++c)
+			chars.push_back(c);
+	}
+	return preload_glyphs(chars, background);
+}
+
+namespace
+{
+	//! Reads a hexadecimal codepoint, with or without a "U+" in front.
+	bool readManifestCodepoint(const c8*& p, const c8* end, uchar32_t& out)
+	{
+		if (end - p >= 2 && (p[0] == 'U' || p[0] == 'u') && p[1] == '+')
+			p += 2;
+
+		const c8* start = p;
+		out = 0;
+		for (; p < end && out <= 0x10FFFF; ++p)
+		{
+			if (*p >= '0' && *p <= '9') out = (out << 4) | (*p - '0');
+			else if (*p >= 'a' && *p <= 'f') out = (out << 4) | (*p - 'a' + 10);
+			else if (*p >= 'A' && *p <= 'F') out = (out << 4) | (*p - 'A' + 10);
+			else break;
+		}
+		return p != start && out <= 0x10FFFF;
+	}
+
+	//! A character written to a glyph manifest.
+	struct SManifestEntry
+	{
+		uchar32_t c;
+		u32 handle;
+		u32 count;
+
+		//! Most used first.
+		bool operator<(const SManifestEntry& other) const
+		{
+			return count != other.count ? count > other.count : c < other.c;
+		}
+	};
+
+	//! Gathers the codepoints in the glyph index map.
+	struct SManifestCollector
+	{
+		SManifestCollector(core::array<SManifestEntry>& entries) : entries(entries) {}
+
+		void operator()(u64 c, u32 handle)
+		{
+			SManifestEntry entry;
+			entry.c = (uchar32_t)c;
+			entry.handle = handle;
+			entry.count = 0;
+			entries.push_back(entry);
+		}
+
+		core::array<SManifestEntry>& entries;
+	};
+}
+
+u32 CGUITTFont::preloadGlyphManifest(const io::path& manifest, bool background)
+{
+	io::IFileSystem* filesystem = Environment ? Environment->getFileSystem() : 0;
+	if (!filesystem || !tt_face)
+		return 0;
+
+	io::IReadFile* file = filesystem->createAndOpenFile(manifest);
+	if (!file)
+		return 0;
+
+	core::array<c8> buffer;
+	buffer.set_used(file->getSize());
+	const bool read = (file->read(buffer.pointer(), buffer.size()) == buffer.size());
+	file->drop();
+	if (!read)
+		return 0;
+
+	// Keep the order of the file, so the most used characters are queued first.
+	core::array<uchar32_t> chars;
+	const c8* p = buffer.const_pointer();
+	const c8* end = p + buffer.size();
+	while (p < end)
+	{
+		const c8* line_end = p;
+		while (line_end < end && *line_end != '\n')
+			++line_end;
+
+		while (p < line_end && (*p == ' ' || *p == '\t'))
+			++p;
+
+		uchar32_t first, last;
+		if (p < line_end && *p != '#' && readManifestCodepoint(p, line_end, first))
+		{
+			last = first;
+			if (p < line_end && *p == '-')
+			{
+				++p;
+				if (!readManifestCodepoint(p, line_end, last))
+					last = first;
+			}
+			for (uchar32_t c = first; c <= last; ++c)
+				chars.push_back(c);
+		}
+
+		// The use count and anything else on the line are only for people reading the file.
+		p = line_end + 1;
+	}
+
+	return preload_glyphs(chars, background);
+}
+
+bool CGUITTFont::saveGlyphManifest(const io::path& manifest, u32 max_entries) const
+{
+	io::IFileSystem* filesystem = Environment ? Environment->getFileSystem() : 0;
+	if (!filesystem || !tt_face)
+		return false;
+
+	// The glyph index caches know every character that was looked up.
+	core::array<SManifestEntry> entries;
+	SManifestCollector collect(entries);
+	for (u32 c = 0; c < Char_Index_Table.size(); ++c)
+	{
+		if (Char_Index_Table[c] != CHAR_INDEX_UNKNOWN)
+			collect(c, Char_Index_Table[c]);
+	}
+	Char_Index_Map.visit(collect);
+
+	// Leave out characters that never showed up on screen, and ones the font doesn't have, which
+	// only got the replacement character.
+	const u32 replacement = FT_Get_Char_Index(tt_face, core::unicode::UTF_REPLACEMENT_CHARACTER);
+	u32 used = 0;
+	for (u32 i = 0; i < entries.size(); ++i)
+	{
+		SManifestEntry& entry = entries[i];
+		if (entry.handle == 0 || (entry.handle == replacement && entry.c != core::unicode::UTF_REPLACEMENT_CHARACTER))
+			continue;
+
+		entry.count = get_glyph(entry.handle).use_count;
+		if (entry.count > 0)
+			entries[used++] = entry;
+	}
+	entries.set_used(used);
+	entries.sort();
+	if (max_entries > 0 && entries.size() > max_entries)
+		entries.set_used(max_entries);
+
+	io::IWriteFile* file = filesystem->createAndWriteFile(manifest);
+	if (!file)
+		return false;
+
+	const c8 header[] = "# CGUITTFont glyph manifest: codepoint, frames used\n";
+	bool ok = file->write(header, sizeof(header) - 1) == sizeof(header) - 1;
+	for (u32 i = 0; ok && i < entries.size(); ++i)
+	{
+		c8 line[32];
+		const u32 length = (u32)snprintf(line, sizeof(line), "%04X %u\n", entries[i].c, entries[i].count);
+		ok = file->write(line, length) == length;
+	}
+
+	file->drop();
+	return ok;
 }
 
 void CGUITTFont::setInvisibleCharacters(const wchar_t *s)
 {
-	core::ustring us(s);
-	Invisible = us;
+	Invisible.clear();
+	while (*s)
+		Invisible.add(readWideChar(s));
+	clearLayoutCache();
 }
 
 void CGUITTFont::setInvisibleCharacters(const core::ustring& s)
 {
-	Invisible = s;
+	Invisible.clear();
+	core::ustring::const_iterator iter = s.begin();
+	while (!iter.atEnd())
+	{
+		Invisible.add(*iter);
+		++iter;
+	}
+	clearLayoutCache();
 }
 
 video::IImage* CGUITTFont::createTextureFromChar(const uchar32_t& ch)
 {
 	u32 n = getGlyphIndexByChar(ch);
-	const SGUITTGlyph& glyph = Glyphs[n-1];
-	CGUITTGlyphPage* page = Glyph_Pages[glyph.glyph_page];
+	const CGUITTGlyphTable& glyphs = get_table(n);
+	const core::recti source_rect = glyphs.getSourceRect(table_index(n));
+	CGUITTGlyphPage* page = Glyph_Pages[glyphs.getPage(table_index(n))];
 
 	if (page->dirty)
 		page->updateTexture();
 
-	video::ITexture* tex = page->texture;
+	// Copy the image data out of our copy of the page.  There's no need to read the texture back.
+	video::IImage* pageholder = page->getImage();
+	core::dimension2du glyph_size(source_rect.getSize());
+	video::IImage* image = Driver->createImage(pageholder->getColorFormat(), glyph_size);
+	pageholder->copyTo(image, core::position2di(0, 0), source_rect);
 
-	// Acquire a read-only lock of the corresponding page texture.
-	void* ptr = tex->lock(video::ETLM_READ_ONLY);
-
-	video::ECOLOR_FORMAT format = tex->getColorFormat();
-	core::dimension2du tex_size = tex->getOriginalSize();
-	video::IImage* pageholder = Driver->createImageFromData(format, tex_size, ptr, true, false);
+	return image;
+}
 
-	// Copy the image data out of the page texture.
-	core::dimension2du glyph_size(glyph.source_rect.getSize());
-	video::IImage* image = Driver->createImage(format, glyph_size);
-	pageholder->copyTo(image, core::position2di(0, 0), glyph.source_rect);
+CGUITTTextSceneNode* CGUITTFont::addTextMeshSceneNode(const wchar_t* text, scene::ISceneManager* smgr, scene::ISceneNode* parent, const video::SColor& color, bool center, s32 id)
+{
+	if (!Driver || !smgr) return 0;
+	if (!parent)
+		parent = smgr->getRootSceneNode();
 
-	tex->unlock();
-	return image;
+	CGUITTTextSceneNode* node = new CGUITTTextSceneNode(this, text, color, center, parent, smgr, id);
+	node->drop(); // The parent holds on to it.
+	return node;
 }
 
 video::ITexture* CGUITTFont::getPageTextureByIndex(const u32& page_index) const
@@ -1023,6 +3366,14 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 	mat.MaterialTypeParam = 0.01f;
 	mat.DiffuseColor = color;
 
+	// Distance field and single channel letters are unlit, so the color goes on the vertices where the shader can see it.
+	if (Distance_Field_Spread > 0 || Single_Channel)
+	{
+		mat.MaterialType = getGlyphMaterialType();
+		mat.setFlag(video::EMF_LIGHTING, false);
+		mat.setFlag(video::EMF_BILINEAR_FILTER, true);
+	}
+
 	wchar_t current_char = 0, previous_char = 0;
 	u32 n = 0;
 
@@ -1046,7 +3397,7 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 		if (line_break)
 		{
 			previous_char = 0;
-			offset.Y -= tt_face->size->metrics.ascender / 64;
+			offset.Y -= Vertical_Metrics.ascender;
 			offset.X = start_point.X;
 			if (center)
 				offset.X += (text_size.Width - getDimensionUntilEndOfLine(text+1).Width) >> 1;
@@ -1060,11 +3411,12 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 				glyph_indices.push_back( n );
 
 				// Store glyph size and offset informations.
-				SGUITTGlyph const& glyph = Glyphs[n-1];
-				u32 texw = glyph.source_rect.getWidth();
-				u32 texh = glyph.source_rect.getHeight();
-				s32 offx = glyph.offset.X;
-				s32 offy = (font_metrics.ascender / 64) - glyph.offset.Y;
+				CGUITTGlyphTable const& glyphs = get_table(n);
+				const core::recti source_rect = glyphs.getSourceRect(table_index(n));
+				u32 texw = source_rect.getWidth();
+				u32 texh = source_rect.getHeight();
+				s32 offx = glyphs.getOffset(table_index(n)).X;
+				s32 offy = Vertical_Metrics.ascender - glyphs.getOffset(table_index(n)).Y;
 
 				// Apply kerning.
 				vector2di k = getKerning(current_char, previous_char);
@@ -1078,6 +3430,8 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 				IMeshManipulator* mani = smgr->getMeshManipulator();
 				IMesh* meshcopy = mani->createMeshCopy(shared_plane_ptr_);
 				mani->scale(meshcopy, vector3df((f32)letter_size.Width, (f32)letter_size.Height, 1));
+				if (Distance_Field_Spread > 0 || Single_Channel)
+					mani->setVertexColors(meshcopy, color);
 
 				ISceneNode* current_node = smgr->addMeshSceneNode(meshcopy, parent, -1, current_pos);
 				meshcopy->drop();
@@ -1101,8 +3455,9 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 	for (u32 i = 0; i < glyph_indices.size(); ++i)
 	{
 		u32 n = glyph_indices[i];
-		SGUITTGlyph const& glyph = Glyphs[n-1];
-		ITexture* current_tex = Glyph_Pages[glyph.glyph_page]->texture;
+		CGUITTGlyphTable const& glyphs = get_table(n);
+		const core::recti source_rect = glyphs.getSourceRect(table_index(n));
+		ITexture* current_tex = Glyph_Pages[glyphs.getPage(table_index(n))]->texture;
 		f32 page_texture_size = (f32)current_tex->getSize().Width;
 		//Now we calculate the UV position according to the texture size and the source rect.
 		//
@@ -1112,10 +3467,10 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 		//  |/  |	<-- the texture coords of point 2 is (0,0, point 0 is (0, 1)
 		//  0---1
 		//
-		f32 u1 = glyph.source_rect.UpperLeftCorner.X / page_texture_size;
-		f32 u2 = u1 + (glyph.source_rect.getWidth() / page_texture_size);
-		f32 v1 = glyph.source_rect.UpperLeftCorner.Y / page_texture_size;
-		f32 v2 = v1 + (glyph.source_rect.getHeight() / page_texture_size);
+		f32 u1 = source_rect.UpperLeftCorner.X / page_texture_size;
+		f32 u2 = u1 + (source_rect.getWidth() / page_texture_size);
+		f32 v1 = source_rect.UpperLeftCorner.Y / page_texture_size;
+		f32 v2 = v1 + (source_rect.getHeight() / page_texture_size);
 
 		//we can be quite sure that this is IMeshSceneNode, because we just added them in the above loop.
 		IMeshSceneNode* node = static_cast<IMeshSceneNode*>(container[i]);
@@ -1134,5 +3489,62 @@ core::array<scene::ISceneNode*> CGUITTFont::addTextSceneNode(const wchar_t* text
 	return container;
 }
 
+//////////////////////
+
+CGUITTScaledFont::CGUITTScaledFont(CGUITTFont* font, f32 scale) : Font(font), Scale(scale)
+{
+	#ifdef _DEBUG
+	setDebugName("CGUITTScaledFont");
+	#endif
+
+	Font->grab();
+}
+
+CGUITTScaledFont::~CGUITTScaledFont()
+{
+	Font->drop();
+}
+
+void CGUITTScaledFont::draw(const core::stringw& text, const core::rect<s32>& position, video::SColor color, bool hcenter, bool vcenter, const core::rect<s32>* clip)
+{
+	Font->drawScaled(text, position, Scale, color, hcenter, vcenter, clip);
+}
+
+core::dimension2d<u32> CGUITTScaledFont::getDimension(const wchar_t* text) const
+{
+	const core::dimension2d<u32> dimension = Font->getDimension(text);
+	return core::dimension2d<u32>(core::ceil32(dimension.Width * Scale), core::ceil32(dimension.Height * Scale));
+}
+
+s32 CGUITTScaledFont::getCharacterFromPos(const wchar_t* text, s32 pixel_x) const
+{
+	return Font->getCharacterFromPos(text, (s32)(pixel_x / Scale));
+}
+
+void CGUITTScaledFont::setKerningWidth(s32 kerning)
+{
+	Font->setKerningWidth(core::round32(kerning / Scale));
+}
+
+void CGUITTScaledFont::setKerningHeight(s32 kerning)
+{
+	Font->setKerningHeight(core::round32(kerning / Scale));
+}
+
+s32 CGUITTScaledFont::getKerningWidth(const wchar_t* thisLetter, const wchar_t* previousLetter) const
+{
+	return core::round32(Font->getKerningWidth(thisLetter, previousLetter) * Scale);
+}
+
+s32 CGUITTScaledFont::getKerningHeight() const
+{
+	return core::round32(Font->getKerningHeight() * Scale);
+}
+
+void CGUITTScaledFont::setInvisibleCharacters(const wchar_t *s)
+{
+	Font->setInvisibleCharacters(s);
+}
+
 } // end namespace gui
 } // end namespace irr
@@ -34,6 +34,10 @@
 #include <irrlicht.h>
 #include <ft2build.h>
 #include "../irrUString.h"
+#include "CGUITTHashMap.h"
+#include "CGUITTGlyphTable.h"
+#include "CGUITTCharSet.h"
+#include "CGUITTGlyphRasterizer.h"
 #include FT_FREETYPE_H
 
 namespace irr
@@ -42,6 +46,7 @@ namespace gui
 {
 	struct SGUITTFace;
 	class CGUITTFont;
+	class CGUITTTextSceneNode;
 
 	//! Class to assist in deleting glyphs.
 	class CGUITTAssistDelete
@@ -55,56 +60,29 @@ namespace gui
 			}
 	};
 
-	//! Structure representing a single TrueType glyph.
-	struct SGUITTGlyph
+	//! Interface for uploading part of a glyph page texture.
+	//! Irrlicht's ITexture can only be updated as a whole through lock()/unlock(). An uploader sends
+	//! only newly paged glyphs to the GPU instead.  CGUITTFont uses CGUITTGLPageUploader on the OpenGL
+	//! driver, and applications can install their own with CGUITTFont::setPageUploader().
+	class IGUITTPageUploader : public virtual IReferenceCounted
 	{
-		//! Constructor.
-		SGUITTGlyph() : isLoaded(false), glyph_page(0), surface(0), parent(0) {}
-
-		//! Destructor.
-		~SGUITTGlyph() { unload(); }
-
-		//! Preload the glyph.
-		//!	The preload process occurs when the program tries to cache the glyph from FT_Library.
-		//! However, it simply defines the SGUITTGlyph's properties and will only create the page
-		//! textures if necessary.  The actual creation of the textures should only occur right
-		//! before the batch draw call.
-		void preload(u32 char_index, FT_Face face, video::IVideoDriver* driver, u32 font_size, const FT_Int32 loadFlags);
-
-		//! Unloads the glyph.
-		void unload();
-
-		//! Creates the IImage object from the FT_Bitmap.
-		video::IImage* createGlyphImage(const FT_Bitmap& bits, video::IVideoDriver* driver) const;
-
-		//! If true, the glyph has been loaded.
-		bool isLoaded;
-
-		//! The page the glyph is on.
-		u32 glyph_page;
-
-		//! The source rectangle for the glyph.
-		core::recti source_rect;
-
-		//! The offset of glyph when drawn.
-		core::vector2di offset;
-
-		//! Glyph advance information.
-		FT_Vector advance;
-
-		//! This is just the temporary image holder.  After this glyph is paged,
-		//! it will be dropped.
-		mutable video::IImage* surface;
-
-		//! The pointer pointing to the parent (CGUITTFont)
-		CGUITTFont* parent;
+		public:
+			//! Uploads a region of pixel data into the texture.
+			//! \param texture The page texture to update.
+			//! \param region The region of the texture to replace.
+			//! \param data Pointer to the first pixel of the region, in the texture's color format.
+			//! \param pitch The number of bytes between rows of data.
+			//! \return False if the upload couldn't be done.  The page then falls back to a full upload.
+			virtual bool uploadRegion(video::ITexture* texture, const core::recti& region, const void* data, u32 pitch) = 0;
 	};
 
 	//! Holds a sheet of glyphs.
+	//! Glyphs are packed onto the page by their actual bitmap size using a skyline
+	//! bottom-left allocator, so narrow glyphs don't waste a full font_size cell.
 	class CGUITTGlyphPage
 	{
 		public:
-			CGUITTGlyphPage(video::IVideoDriver* Driver, const io::path& texture_name) :texture(0), available_slots(0), used_slots(0), dirty(false), driver(Driver), name(texture_name) {}
+			CGUITTGlyphPage(video::IVideoDriver* Driver, const io::path& texture_name) :texture(0), used_slots(0), used_area(0), wasted_area(0), dirty(false), has_dirty_rect(false), image(0), needs_full_upload(true), pixel_mode(0), uploader(0), driver(Driver), name(texture_name) {}
 			~CGUITTGlyphPage()
 			{
 				if (texture)
@@ -113,90 +91,235 @@ namespace gui
 						driver->removeTexture(texture);
 					else texture->drop();
 				}
+				if (image)
+					image->drop();
+				if (uploader)
+					uploader->drop();
 			}
 
 			//! Create the actual page texture,
-			bool createPageTexture(const u8& pixel_mode, const core::dimension2du& texture_size)
+			//! \param single_channel If true, the page is an ECF_R8 texture holding glyph coverage in red.
+			//! Falls back to the usual format if the driver can't create or lock one.
+			bool createPageTexture(const u8& pixel_mode, const core::dimension2du& texture_size, bool single_channel = false);
+
+			//! Reserves a rectangle on the page.
+			//! \param rect_size The size of the rectangle, including any padding.
+			//! \param out_rect Receives the reserved rectangle.
+			//! \return True if the page had room for the rectangle.
+			bool allocateRect(const core::dimension2du& rect_size, core::recti& out_rect);
+
+			//! Writes a glyph bitmap into the CPU-side copy of the page, converting it to the page's format.
+			//! The texture catches up at the next updateTexture().
+			//! \param bits A FT_PIXEL_MODE_MONO or FT_PIXEL_MODE_GRAY bitmap.
+			//! \param pos Where the upper left corner of the bitmap goes.  There must be room for it.
+			//! \return False if the bitmap's pixel mode isn't supported.
+			bool writeGlyph(const FT_Bitmap& bits, const core::vector2di& pos);
+
+			//! Updates the texture atlas with new glyphs.
+			//! Only the region covering the newly written glyphs is uploaded when a page uploader is set.
+			void updateTexture();
+
+			//! Sets the uploader used for partial texture updates.  Pass zero to always upload the whole page.
+			void setUploader(IGUITTPageUploader* page_uploader)
 			{
-				if( texture )
-					return false;
+				if (page_uploader)
+					page_uploader->grab();
+				if (uploader)
+					uploader->drop();
+				uploader = page_uploader;
+			}
 
-				bool flgmip = driver->getTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS);
-				driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, false);
+			//! Returns the CPU-side copy of the page, which always matches what has been uploaded.
+			video::IImage* getImage() const { return image; }
 
-				// Set the texture color format.
-				switch (pixel_mode)
-				{
-					case FT_PIXEL_MODE_MONO:
-						texture = driver->addTexture(texture_size, name, video::ECF_A1R5G5B5);
-						break;
-					case FT_PIXEL_MODE_GRAY:
-					default:
-						texture = driver->addTexture(texture_size, name, video::ECF_A8R8G8B8);
-						break;
-				}
+			//! Returns the FreeType pixel mode the page was created for.
+			u8 getPixelMode() const { return pixel_mode; }
 
-				// Restore our texture creation flags.
-				driver->setTextureCreationFlag(video::ETCF_CREATE_MIP_MAPS, flgmip);
-				return texture ? true : false;
-			}
+			//! Returns true if the page is an ECF_R8 texture holding glyph coverage in red.
+			bool isSingleChannel() const { return image && image->getColorFormat() == video::ECF_R8; }
+
+			//! Turns a single channel page into an ECF_A8R8G8B8 page holding the same glyphs.
+			//! \return False if the new texture couldn't be created.  The page is left as it was then.
+			bool convertToA8R8G8B8();
+
+			//! Copies a glyph out of another page's image, widening single channel pixels if needed.
+			//! \return False if the formats can't be converted.
+			bool copyGlyph(video::IImage* source, const core::recti& source_rect, const core::vector2di& pos);
 
-			//! Add the glyph to a list of glyphs to be paged.
-			//! This collection will be cleared after updateTexture is called.
-			void pushGlyphToBePaged(const SGUITTGlyph* glyph)
+			//! Writes the page's pixels and packing state to a glyph cache file.
+			bool writeCache(io::IWriteFile* file) const;
+
+			//! Restores the pixels and packing state written by writeCache().
+			//! The page texture must already have been created with the same size.
+			//! \param data The cache data, advanced past the page on success.
+			//! \param end The end of the cache data.
+			//! \return False if the data is damaged or was written for a different texture format.
+			bool readCache(const u8*& data, const u8* end);
+
+			//! Returns the total area of the page in pixels.
+			u32 getTotalArea() const
 			{
-				glyph_to_be_paged.push_back(glyph);
+				return texture ? texture->getOriginalSize().getArea() : 0;
 			}
 
-			//! Updates the texture atlas with new glyphs.
-			void updateTexture()
+			//! Returns the fraction (0 to 1) of the page covered by packed glyphs, padding included.
+			f32 getOccupancy() const
 			{
-				if (!dirty) return;
-
-				void* ptr = texture->lock();
-				video::ECOLOR_FORMAT format = texture->getColorFormat();
-				core::dimension2du size = texture->getOriginalSize();
-				video::IImage* pageholder = driver->createImageFromData(format, size, ptr, true, false);
-
-				for (u32 i = 0; i < glyph_to_be_paged.size(); ++i)
-				{
-					const SGUITTGlyph* glyph = glyph_to_be_paged[i];
-					if (glyph && glyph->isLoaded)
-					{
-						if (glyph->surface)
-						{
-							glyph->surface->copyTo(pageholder, glyph->source_rect.UpperLeftCorner);
-							glyph->surface->drop();
-							glyph->surface = 0;
-						}
-						else
-						{
-							; // TODO: add error message?
-							//currently, if we failed to create the image, just ignore this operation.
-						}
-					}
-				}
+				const u32 total = getTotalArea();
+				return total ? (f32)used_area / (f32)total : 0.f;
+			}
 
-				pageholder->drop();
-				texture->unlock();
-				glyph_to_be_paged.clear();
-				dirty = false;
+			//! Returns the fraction (0 to 1) of the page trapped under the skyline that can no longer be used.
+			f32 getWastedFraction() const
+			{
+				const u32 total = getTotalArea();
+				return total ? (f32)wasted_area / (f32)total : 0.f;
 			}
 
 			video::ITexture* texture;
-			u32 available_slots;
+
+			//! Number of glyphs packed onto this page.
 			u32 used_slots;
+
+			//! Pixel area occupied by packed glyph rectangles.
+			u32 used_area;
+
+			//! Pixel area below the skyline that was skipped over and can't be reached anymore.
+			u32 wasted_area;
+
 			bool dirty;
 
 			core::array<core::vector2di> render_positions;
 			core::array<core::recti> render_source_rects;
 
 		private:
-			core::array<const SGUITTGlyph*> glyph_to_be_paged;
+			//! A horizontal segment of the packed region's upper outline.
+			struct SSkylineNode
+			{
+				SSkylineNode() : x(0), y(0), width(0) {}
+				SSkylineNode(s32 X, s32 Y, s32 Width) : x(X), y(Y), width(Width) {}
+				s32 x;
+				s32 y;
+				s32 width;
+			};
+
+			//! Finds the lowest y a rectangle of the given width can rest at when placed at node index.
+			//! \return -1 if the rectangle doesn't fit there.
+			s32 fitSkyline(u32 index, s32 width, s32 height) const;
+
+			core::array<SSkylineNode> skyline;
+
+			//! Area covered by glyphs written since the last upload.
+			core::recti dirty_rect;
+			bool has_dirty_rect;
+
+			//! CPU-side copy of the page.  Uploads are made from here so the texture never has to be read back.
+			video::IImage* image;
+
+			//! If true, the next upload has to replace the whole texture.
+			bool needs_full_upload;
+
+			u8 pixel_mode;
+
+			IGUITTPageUploader* uploader;
 			video::IVideoDriver* driver;
 			io::path name;
 	};
 
+	//! A string laid out by CGUITTFont, ready to be handed to the driver.
+	//! Kept in the font's layout cache so unchanged text isn't laid out again every frame.
+	struct SGUITTTextLayout
+	{
+		SGUITTTextLayout() : key(0), width(0), height(0), wrap_width(0), hcenter(false), vcenter(false), laid_out(false), pending(false), batch_count(0), has_advances(false), last_used(0) {}
+
+		//! The glyphs drawn from a single page.
+		struct SBatch
+		{
+			u32 page;
+			core::array<core::vector2di> positions;
+			core::array<core::recti> source_rects;
+		};
+
+		//! A line of laid out text.  begin and end index wchar_t's of the text, so a line can be cut
+		//! out with subString(begin, end - begin).  The line break, and the spaces a wrapped line
+		//! ended at, are left out.
+		struct SLine
+		{
+			u32 begin;
+			u32 end;
+			s32 width;
+		};
+
+		//! Cache key and the parameters it was made from, used to detect hash collisions.
+		u64 key;
+		core::stringw text;
+		s32 width;
+		s32 height;
+		s32 wrap_width;
+		bool hcenter;
+		bool vcenter;
+
+		//! Dimension of the text, as returned by getDimension().
+		core::dimension2du dimension;
+
+		//! If false, only the dimension has been computed.
+		bool laid_out;
+
+		//! If true, some glyphs were still loading in the background when the text was laid out,
+		//! so the layout has to be redone once they arrive.
+		bool pending;
+
+		//! The upper left corner the batch positions were computed for.
+		core::vector2di origin;
+
+		//! Batches are reused between layouts, so only the first batch_count of them are valid.
+		core::array<SBatch> batches;
+		u32 batch_count;
+
+		//! The lines the text was broken into.  Lines only end at line breaks unless wrap_width is set.
+		core::array<SLine> lines;
+
+		//! Indices of the glyphs drawn, so drawing a cached layout can mark them as used.
+		core::array<u32> glyphs;
+
+		//! Pen position after each character, measured the way getCharacterFromPos() does, and the
+		//! running maximum of those positions for binary searching.  Filled in by hit-testing.
+		core::array<s32> advances;
+		core::array<s32> advance_max;
+		bool has_advances;
+
+		//! Cache tick of the last lookup, for least-recently-used eviction.
+		u32 last_used;
+	};
+
+	//! An inclusive range of characters, for CGUITTFont::preloadGlyphs().
+	struct SGUITTCharRange
+	{
+		SGUITTCharRange() : first(0), last(0) {}
+		SGUITTCharRange(uchar32_t first, uchar32_t last) : first(first), last(last) {}
+
+		uchar32_t first;
+		uchar32_t last;
+	};
+
+	//! Vertical metrics of a CGUITTFont in pixels.
+	struct SGUITTVerticalMetrics
+	{
+		SGUITTVerticalMetrics() : ascender(0), descender(0), line_gap(0), line_height(0) {}
+
+		//! Distance from the top of a line to the baseline.  Lines of text are this far apart.
+		s32 ascender;
+
+		//! Distance from the baseline to the bottom of the font's glyphs.  Negative below the baseline.
+		s32 descender;
+
+		//! Extra space the font designer asks for between lines.
+		s32 line_gap;
+
+		//! Height of a line as reported by getDimension(): the tallest of 'g', 'j' and '_' plus a one pixel border.
+		s32 line_height;
+	};
+
 	//! Class representing a TrueType font.
 	class CGUITTFont : public IGUIFont
 	{
@@ -207,11 +330,13 @@ namespace gui
 			//! \param size The size of the font glyphs in pixels.  Since this is the size of the individual glyphs, the true height of the font may change depending on the characters used.
 			//! \param antialias set the use_monochrome (opposite to antialias) flag
 			//! \param transparency set the use_transparency flag
+			//! \param glyph_cache A glyph cache file written by saveGlyphCache().  If it matches the font, the
+			//! glyphs are restored from it instead of being rendered.
 			//! \return Returns a pointer to a CGUITTFont.  Will return 0 if the font failed to load.
-			static CGUITTFont* createTTFont(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true);
-			static CGUITTFont* createTTFont(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true);
-			static CGUITTFont* create(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true);
-			static CGUITTFont* create(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true);
+			static CGUITTFont* createTTFont(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true, const io::path& glyph_cache = "");
+			static CGUITTFont* createTTFont(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true, const io::path& glyph_cache = "");
+			static CGUITTFont* create(IGUIEnvironment *env, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true, const io::path& glyph_cache = "");
+			static CGUITTFont* create(IrrlichtDevice *device, const io::path& filename, const u32 size, const bool antialias = true, const bool transparency = true, const io::path& glyph_cache = "");
 
 			//! Destructor
 			virtual ~CGUITTFont();
@@ -222,9 +347,131 @@ namespace gui
 			//! Sets the maximum texture size for a page of glyphs.
 			virtual void setMaxPageTextureSize(const core::dimension2du& texture_size) { max_page_texture_size = texture_size; }
 
+			//! Sets the uploader the glyph pages use to send only newly paged glyphs to the GPU.
+			//! Default: CGUITTGLPageUploader on the OpenGL driver, none on the others.
+			//! \param page_uploader The uploader, or zero to always upload whole pages.
+			virtual void setPageUploader(IGUITTPageUploader* page_uploader);
+
+			//! Saves the loaded glyphs and their pages to a cache file, so that a later run can restore
+			//! them with loadGlyphCache() instead of rendering them again.
+			//! The file is only valid for the same font file, size and loading flags.
+			//! Only glyphs of this font's own face are saved.  Glyphs of fallback fonts aren't, since
+			//! the cache is restored before fallback fonts are added; they are loaded again when needed,
+			//! and the space they took on the saved pages is only reclaimed when the pages are repacked.
+			//! \return True if the file was written.
+			virtual bool saveGlyphCache(const io::path& cache_file) const;
+
+			//! Replaces the loaded glyphs with the ones in a cache file written by saveGlyphCache().
+			//! \return False if the file is missing, damaged, or was written for a different font,
+			//! size or loading flags.  The font is left without any loaded glyphs if the file was damaged.
+			virtual bool loadGlyphCache(const io::path& cache_file);
+
+			//! Sets the number of threads used to render glyphs when a batch of them is loaded.
+			//! Each thread opens its own copy of the font face.  Glyphs are still placed on the pages
+			//! and uploaded by the calling thread.
+			//! Default: 0.
+			//! \param count The number of threads.  Zero renders glyphs on the calling thread.
+			virtual void setRasterizerThreadCount(u32 count);
+
+			//! Returns the number of glyph rendering threads that are running.
+			u32 getRasterizerThreadCount() const { return Rasterizer ? Rasterizer->getThreadCount() : 0; }
+
+			//! Enables asynchronous glyph loading.
+			//! Glyphs that aren't loaded yet are rendered in the background instead of stalling the caller.
+			//! Until they arrive, text is drawn and measured with the placeholder character in their place.
+			//! Finished glyphs are put on the pages at the start of draw(), see setGlyphCommitBudget().
+			//! Starts one rasterizer thread if none are running.  Disabling waits for the queued glyphs.
+			//! Default: false.
+			virtual void setAsyncGlyphLoading(bool enable);
+
+			//! Returns true if glyphs are loaded in the background.
+			bool isAsyncGlyphLoading() const { return Async_Loading; }
+
+			//! Sets the character drawn in place of glyphs that are still loading.
+			//! \param c The character, or zero to leave the space empty.  Default: 0.
+			virtual void setPlaceholderCharacter(uchar32_t c) { Placeholder_Char = c; clearLayoutCache(); }
+
+			//! Sets the most background-loaded glyphs that are put on the glyph pages in one frame.
+			//! Frames are told apart by the device timer, so fonts created from an IGUIEnvironment
+			//! without a device apply the budget to every draw() call instead.
+			//! \param glyphs The number of glyphs per frame.  Zero means no limit.  Default: 0.
+			virtual void setGlyphCommitBudget(u32 glyphs) { Commit_Budget = glyphs; }
+
+			//! Returns true if glyphs are still loading in the background.
+			//! Text drawn while this is true may be missing glyphs and should be drawn again later.
+			bool needsRedraw() const { return Async_Pending > 0; }
+
+			//! Loads the glyphs of every character in a string, such as the text of the first screen.
+			//! Unlike setBatchLoadSize(), only the listed characters are loaded.
+			//! \param text The characters to load.  Repeated characters are only loaded once.
+			//! \param background If true, the glyphs are rendered by the rasterizer threads and put on the
+			//! pages by later draw() calls, starting one thread if none are running.  Without asynchronous
+			//! loading, a glyph that is looked up before it arrives is rendered on the spot, so text is
+			//! never drawn with placeholders.  Fallback font glyphs are always loaded right away.
+			//! \return The number of glyphs loaded or queued.
+			virtual u32 preloadGlyphs(const core::ustring& text, bool background = false);
+
+			//! Loads the glyphs of every character in a set of ranges, such as a script's Unicode block.
+			//! \see preloadGlyphs(const core::ustring&, bool)
+			virtual u32 preloadGlyphs(const core::array<SGUITTCharRange>& ranges, bool background = false);
+
+			//! Loads the glyphs listed in a manifest file, most used first.
+			//! Manifests are written by saveGlyphManifest(), or by hand.  Each line holds a hexadecimal
+			//! codepoint or an inclusive range like "4E00-4E5F", optionally followed by a use count.
+			//! Text after a '#' is ignored.
+			//! \see preloadGlyphs(const core::ustring&, bool)
+			//! \return The number of glyphs loaded or queued.  Zero if the file couldn't be read.
+			virtual u32 preloadGlyphManifest(const io::path& manifest, bool background = false);
+
+			//! Writes the characters this font has drawn or measured to a manifest file, ordered by
+			//! the number of frames each was used in.  Load it with preloadGlyphManifest() in a later
+			//! session to warm the glyph pages with the characters that application actually uses.
+			//! \param max_entries The most characters to write.  Zero writes all of them.
+			//! \return True if the file was written.
+			virtual bool saveGlyphManifest(const io::path& manifest, u32 max_entries = 0) const;
+
+			//! Limits the number of glyph pages the font keeps.
+			//! When a draw finds more pages than this, the glyphs are repacked with the least recently used
+			//! ones thrown away, leaving a page free for new glyphs.  Thrown away glyphs are loaded again
+			//! the next time they are needed.  Frames are told apart the same way as for setGlyphCommitBudget().
+			//! The pages are repacked at most once a frame, so a frame drawing more glyphs than fit in the
+			//! budget goes over it until a later frame.
+			//! \param pages The most pages to keep.  Zero means no limit.  Default: 0.
+			virtual void setGlyphPageBudget(u32 pages) { Page_Budget = pages; }
+
+			//! Returns the glyph page limit set with setGlyphPageBudget().
+			u32 getGlyphPageBudget() const { return Page_Budget; }
+
+			//! Throws away glyphs that haven't been used for a while and repacks the rest onto as few pages as possible.
+			//! Useful after a burst of rarely used characters, such as a chat log full of CJK text, has scrolled away.
+			//! \param unused_frames Glyphs not looked up or drawn within this many frames are thrown away.
+			//! Zero keeps every loaded glyph and only repacks them.
+			virtual void compactGlyphPages(u32 unused_frames = 0);
+
+			//! Returns the number of bytes used by the glyph pages, counting both the textures and their CPU-side copies.
+			u32 getGlyphPageMemory() const;
+
+			//! Sets the number of laid out strings kept by draw() and getDimension().
+			//! Default: 256.
+			//! \param entries The number of strings to keep.  Zero disables the layout cache.
+			virtual void setLayoutCacheSize(u32 entries);
+
+			//! Throws away all cached text layouts.
+			virtual void clearLayoutCache();
+
+			//! Returns the number of layout cache lookups that found a usable layout.
+			u32 getLayoutCacheHits() const { return Layout_Cache_Hits; }
+
+			//! Returns the number of layout cache lookups that had to lay the text out.
+			u32 getLayoutCacheMisses() const { return Layout_Cache_Misses; }
+
 			//! Get the font size.
 			virtual u32 getFontSize() const { return size; }
 
+			//! Returns the vertical metrics of the font.
+			//! They are worked out when the font is loaded and again after the glyphs are reset, not on every measurement.
+			const SGUITTVerticalMetrics& getVerticalMetrics() const { get_line_height(); return Vertical_Metrics; }
+
 			//! Check the font's transparency.
 			virtual bool isTransparent() const { return use_transparency; }
 
@@ -255,11 +502,67 @@ namespace gui
 			//! \param enable_auto_hinting If true, FreeType uses its own auto-hinting algorithm.  If false, it tries to use the algorithm specified by the font.
 			virtual void setFontHinting(const bool enable, const bool enable_auto_hinting = true);
 
+			//! Enables signed distance field glyphs.
+			//! The pages then store each pixel's distance to the glyph outline instead of its coverage,
+			//! which stays sharp when magnified.  One font can serve many display sizes through
+			//! createScaledFont(), and 3D text from addTextSceneNode() stays crisp up close.
+			//! Drawing uses a GLSL shader on OpenGL and an alpha test on other drivers (such as Burnings' Video).
+			//! All glyphs are reloaded when this changes.
+			//! Default: disabled.
+			//! \param enable If true, glyphs are rendered as distance fields.
+			//! \param spread The distance in pixels the field covers on each side of the outline.
+			//! Larger values allow more magnification but take more room on the pages.
+			virtual void setDistanceField(bool enable, u32 spread = 4);
+
+			//! Returns the distance field spread in pixels, or zero if distance field glyphs are disabled.
+			u32 getDistanceFieldSpread() const { return Distance_Field_Spread; }
+
+			//! Stores glyph pages as single channel ECF_R8 textures instead of ECF_A8R8G8B8.
+			//! Pages take a quarter of the memory and upload bandwidth, but can only be drawn with the
+			//! font's shader, which tints the glyphs by vertex color.  See getGlyphMaterialType().
+			//! Drivers without GLSL or ECF_R8 textures keep using ECF_A8R8G8B8 pages, as do drivers that fail
+			//! to create or lock an ECF_R8 page later on.  useSingleChannelPages() turns false then.
+			//! All glyphs are reloaded when this changes.
+			//! Default: disabled.
+			//! \return True if single channel pages are in use.
+			virtual bool setSingleChannelPages(bool enable);
+
+			//! Returns true if glyph pages are single channel ECF_R8 textures.
+			bool useSingleChannelPages() const { return Single_Channel; }
+
+			//! Converts a rendered glyph bitmap to a distance field, adding the spread as a margin.
+			//! \param bits The glyph bitmap.
+			//! \param out Receives the distance field.  Its buffer belongs to the font and is only valid until the next call.
+			void makeDistanceField(const FT_Bitmap& bits, FT_Bitmap& out);
+
+			//! Creates a font that draws this font's glyphs at a different size, sharing its glyph pages.
+			//! Works best with distance field glyphs; plain glyphs get blurry when magnified.
+			//! \param display_size The size of the glyphs in pixels, as passed to createTTFont().
+			//! \return The new font.  It must be drop()'ed when finished.
+			IGUIFont* createScaledFont(u32 display_size);
+
 			//! Draws some text and clips it to the specified rectangle if wanted.
 			virtual void draw(const core::stringw& text, const core::rect<s32>& position,
 				video::SColor color, bool hcenter=false, bool vcenter=false,
 				const core::rect<s32>* clip=0);
 
+			//! Draws some text magnified or shrunk by a factor.
+			//! \param scale The factor the glyphs are scaled by.
+			void drawScaled(const core::stringw& text, const core::rect<s32>& position, f32 scale,
+				video::SColor color, bool hcenter=false, bool vcenter=false,
+				const core::rect<s32>* clip=0);
+
+			//! Draws text word-wrapped to the width of the rectangle.
+			//! Lines are broken at spaces, after hyphens and between CJK characters, and words wider
+			//! than the rectangle are broken wherever they overflow.  With hcenter, each line is centered
+			//! on its own.  The wrapped layout is cached like the one of draw().
+			void drawWrapped(const core::stringw& text, const core::rect<s32>& position,
+				video::SColor color, bool hcenter=false, bool vcenter=false,
+				const core::rect<s32>* clip=0);
+
+			//! Returns the dimension of text word-wrapped to a width, as drawn by drawWrapped().
+			core::dimension2d<u32> getWrappedDimension(const wchar_t* text, s32 wrap_width) const;
+
 			//! Returns the dimension of a character produced by this font.
 			virtual core::dimension2d<u32> getCharDimension(const wchar_t ch) const;
 
@@ -268,9 +571,31 @@ namespace gui
 			virtual core::dimension2d<u32> getDimension(const core::ustring& text) const;
 
 			//! Calculates the index of the character in the text which is on a specific position.
+			//! The character positions are cached with the text's layout, so calling this again for the
+			//! same text, as edit boxes do on every mouse move, is a binary search.
 			virtual s32 getCharacterFromPos(const wchar_t* text, s32 pixel_x) const;
 			virtual s32 getCharacterFromPos(const core::ustring& text, s32 pixel_x) const;
 
+			//! Returns the horizontal position of the caret in front of a character, relative to the start of the text.
+			//! Uses the same cached positions as getCharacterFromPos(), so carets and selection rectangles
+			//! line up with the characters it finds.
+			//! \param index The index of the character.  The length of the text gives the end of the text.
+			s32 getCaretPosition(const wchar_t* text, u32 index) const;
+
+			//! Measures the character positions of some text into a layout owned by the caller.
+			//! The overloads taking the text look it up in the layout cache, which hashes and compares
+			//! the whole text on every call.  Edit boxes holding long text can keep the layout instead,
+			//! so each hit-test is only a binary search.
+			//! \return False if some glyphs were still loading in the background.  Measure the text again later.
+			bool getCharacterPositions(const wchar_t* text, SGUITTTextLayout& layout) const;
+
+			//! Hit-tests character positions measured by getCharacterPositions().
+			//! \return The index of the character, or -1 if pixel_x is past the end of the text.
+			s32 getCharacterFromPos(const SGUITTTextLayout& layout, s32 pixel_x) const;
+
+			//! Returns the caret position in front of a character, from positions measured by getCharacterPositions().
+			s32 getCaretPosition(const SGUITTTextLayout& layout, u32 index) const;
+
 			//! Sets global kerning width for the font.
 			virtual void setKerningWidth(s32 kerning);
 
@@ -284,22 +609,61 @@ namespace gui
 			//! Returns the distance between letters
 			virtual s32 getKerningHeight() const;
 
+			//! Fills the kerning cache for every pair of characters in the given range up front,
+			//! so text in that range never has to query FreeType for kerning while drawing.
+			//! Only the font's 'kern' table is used; FreeType doesn't read GPOS kerning.
+			//! \param first The first character of the range.
+			//! \param last The last character of the range.
+			virtual void preloadKerning(const uchar32_t first = 32, const uchar32_t last = 126);
+
 			//! Define which characters should not be drawn by the font.
 			virtual void setInvisibleCharacters(const wchar_t *s);
 			virtual void setInvisibleCharacters(const core::ustring& s);
 
-			//! Get the last glyph page if there's still available slots.
-			//! If not, it will return zero.
-			CGUITTGlyphPage* getLastGlyphPage() const;
+			//! Adds a font to the fallback chain.
+			//! Characters this font doesn't have are looked up in the fallback fonts, in the order they were
+			//! added, before falling back to the replacement character.  Glyphs from fallback fonts are
+			//! rendered at this font's size and share its glyph pages, so mixed text still draws in one
+			//! batch per page.  Fallback glyphs are always rendered on the calling thread.
+			//! \param filename The font file.  Faces are shared with other fonts using the same file.
+			//! \return False if the font couldn't be opened, or the chain already has 255 fonts.
+			virtual bool addFallbackFont(const io::path& filename);
+
+			//! Removes every font from the fallback chain.  All glyphs are reloaded.
+			virtual void clearFallbackFonts();
+
+			//! Returns the number of fonts in the fallback chain.
+			u32 getFallbackFontCount() const { return Fallback_Faces.size(); }
+
+			//! Reserves room for a glyph bitmap on a glyph page, creating a new page if no existing page has space.
+			//! \param glyph_size The size of the glyph bitmap.  Padding is added internally.
+			//! \param pixel_mode The pixel mode defined by FT_Pixel_Mode, used when a new page has to be created.
+			//! \param out_rect Receives the glyph's source rectangle on the page.
+			//! \param out_page_index Receives the index of the page the glyph was placed on.
+			//! \param new_page If false, only the existing pages are tried.
+			//! \return The page the glyph was placed on, or zero on failure.
+			CGUITTGlyphPage* allocateGlyphRect(const core::dimension2du& glyph_size, const u8& pixel_mode, core::recti& out_rect, u32& out_page_index, bool new_page = true);
 
 			//! Create a new glyph page texture.
 			//! \param pixel_mode the pixel mode defined by FT_Pixel_Mode
 			//should be better typed. fix later.
 			CGUITTGlyphPage* createGlyphPage(const u8& pixel_mode);
 
+			//! Create a new glyph page texture of the given size.
+			CGUITTGlyphPage* createGlyphPage(const u8& pixel_mode, const core::dimension2du& texture_size);
+
 			//! Get the last glyph page's index.
 			u32 getLastGlyphPageIndex() const { return Glyph_Pages.size() - 1; }
 
+			//! Get the number of glyph pages currently in use.
+			u32 getGlyphPageCount() const { return Glyph_Pages.size(); }
+
+			//! Get a glyph page, mostly for reading its occupancy statistics. If the page doesn't exist it returns zero.
+			const CGUITTGlyphPage* getGlyphPageByIndex(const u32& page_index) const
+			{
+				return page_index < Glyph_Pages.size() ? Glyph_Pages[page_index] : 0;
+			}
+
 			//! Create corresponding character's software image copy from the font,
 			//! so you can use this data just like any ordinary video::IImage.
 			//! \param ch The character you need
@@ -314,6 +678,35 @@ namespace gui
 				(const wchar_t* text, scene::ISceneManager* smgr, scene::ISceneNode* parent = 0,
 				 const video::SColor& color = video::SColor(255, 0, 0, 0), bool center = false );
 
+			//! Adds a single scene node drawing the text, with one mesh buffer per glyph page.
+			//! Unlike addTextSceneNode(), the text can be changed later with CGUITTTextSceneNode::setText().
+			//! \return The node.  It is owned by the scene manager; grab() it to keep it around.
+			virtual CGUITTTextSceneNode* addTextMeshSceneNode
+				(const wchar_t* text, scene::ISceneManager* smgr, scene::ISceneNode* parent = 0,
+				 const video::SColor& color = video::SColor(255, 0, 0, 0), bool center = false, s32 id = -1);
+
+			//! Lays text out into a layout owned by the caller, for drawing it some other way.
+			//! The positions are relative to the upper left corner of the text, with Y pointing down.
+			//! \param wrap_width If greater than zero, lines are wrapped to this width as by drawWrapped().
+			//! The lines are listed in SGUITTTextLayout::lines.
+			//! Glyphs already on the pages never move during this call.  Call prepareFrame() once a frame
+			//! before laying text out, so the pages are repacked when they go over budget.
+			//! \return False if some glyphs were still loading in the background.  Lay the text out again later.
+			bool getTextLayout(const core::stringw& text, SGUITTTextLayout& layout, s32 wrap_width=0);
+
+			//! Puts glyphs loaded in the background on the pages, and repacks the pages once a frame if
+			//! they are over the budget set by setPageBudget().  The draw calls do this themselves.
+			//! Text scene nodes call it when they register, so glyphs only move before the first node of a
+			//! frame is laid out.
+			void prepareFrame() { prepare_draw(); }
+
+			//! Returns the material type glyph quads are drawn with.
+			video::E_MATERIAL_TYPE getGlyphMaterialType();
+
+			//! Returns a number that changes whenever loaded glyphs are thrown away or moved on the pages,
+			//! so anything keeping their source rectangles knows to lay its text out again.
+			u32 getPageGeneration() const { return Page_Generation; }
+
 		protected:
 			bool use_monochrome;
 			bool use_transparency;
@@ -328,20 +721,45 @@ namespace gui
 			static FT_Library c_library;
 			static core::map<io::path, SGUITTFace*> c_faces;
 			static bool c_libraryLoaded;
+			static SGUITTFace* grab_face(const io::path& filename, io::IFileSystem* filesystem, irr::ILogger* logger);
+			static void drop_face(const io::path& filename, FT_Size face_size);
 			static scene::IMesh* shared_plane_ptr_;
 			static scene::SMesh  shared_plane_;
 
+			// The glyph shader materials, made once per video driver.  Indexed by get_glyph_shader_material().
+			static video::IVideoDriver* c_glyphShaderDriver;
+			static s32 c_glyphShaderMaterials[4];
+
 			CGUITTFont(IGUIEnvironment *env);
-			bool load(const io::path& filename, const u32 size, const bool antialias, const bool transparency);
+			bool load(const io::path& filename, const u32 size, const bool antialias, const bool transparency, const io::path& glyph_cache);
 			void reset_images();
+			s32 get_line_height() const;
 			void update_glyph_pages() const;
+			void create_rasterizer();
+			u64 get_font_hash() const;
+			void begin_frame();
+			void prepare_draw();
+			void repack_glyph_pages(u32 max_pages);
+			void commit_pending_glyphs();
+			void commit_glyph(const SGUITTRasterizedGlyph& rendered) const;
+			SGUITTGlyph& get_glyph(u32 handle) const;
+			CGUITTGlyphTable& get_table(u32 handle) const;
+			static u32 table_index(u32 handle) { return (handle & GLYPH_INDEX_MASK) - 1; }
+			FT_Face get_face(u32 handle) const;
+			FT_Size get_size(u32 handle) const;
+			void load_glyph(u32 handle) const;
+			void place_glyph(u32 handle, const FT_Bitmap& bits, s32 advance, s32 left, s32 top) const;
+			void cancel_pending_glyphs();
+			u32 pending_stand_in() const;
+			u32 preload_glyphs(const core::array<uchar32_t>& chars, bool background);
 			void update_load_flags()
 			{
 				// Set up our loading flags.
 				load_flags = FT_LOAD_DEFAULT | FT_LOAD_RENDER;
 				if (!useHinting()) load_flags |= FT_LOAD_NO_HINTING;
 				if (!useAutoHinting()) load_flags |= FT_LOAD_NO_AUTOHINT;
-				if (useMonochrome()) load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_TARGET_MONO | FT_RENDER_MODE_MONO;
+				// Distance fields are made from antialiased glyphs.
+				if (useMonochrome() && Distance_Field_Spread == 0) load_flags |= FT_LOAD_MONOCHROME | FT_LOAD_TARGET_MONO | FT_RENDER_MODE_MONO;
 				else load_flags |= FT_LOAD_TARGET_NORMAL;
 			}
 			u32 getWidthFromCharacter(wchar_t c) const;
@@ -350,9 +768,25 @@ namespace gui
 			u32 getHeightFromCharacter(uchar32_t c) const;
 			u32 getGlyphIndexByChar(wchar_t c) const;
 			u32 getGlyphIndexByChar(uchar32_t c) const;
+			u32 getCachedCharIndex(uchar32_t c) const;
 			core::vector2di getKerning(const wchar_t thisLetter, const wchar_t previousLetter) const;
 			core::vector2di getKerning(const uchar32_t thisLetter, const uchar32_t previousLetter) const;
+			core::vector2di getGlyphKerning(const u32 thisGlyph, const u32 previousGlyph) const;
 			core::dimension2d<u32> getDimensionUntilEndOfLine(const wchar_t* p) const;
+			core::dimension2d<u32> measureText(const wchar_t* text) const;
+			SGUITTTextLayout* findTextLayout(const wchar_t* text, s32 width, s32 height, bool hcenter, bool vcenter, s32 wrap_width, u64& out_key) const;
+			SGUITTTextLayout* addTextLayout(const wchar_t* text, s32 width, s32 height, bool hcenter, bool vcenter, s32 wrap_width, u64 key) const;
+			void layoutText(SGUITTTextLayout& layout, const core::rect<s32>& position);
+			void break_lines(const wchar_t* text, s32 wrap_width, core::array<SGUITTTextLayout::SLine>& lines) const;
+			core::dimension2d<u32> measure_lines(const core::array<SGUITTTextLayout::SLine>& lines) const;
+			const SGUITTTextLayout& get_advances(const wchar_t* text) const;
+			bool measure_advances(const wchar_t* text, SGUITTTextLayout& layout) const;
+			SGUITTTextLayout& get_layout(const core::stringw& text, const core::rect<s32>& position, bool hcenter, bool vcenter, s32 wrap_width);
+			void draw_layout(const SGUITTTextLayout& layout, const core::vector2di& origin, video::SColor color, const core::rect<s32>* clip);
+			void draw_quads(const SGUITTTextLayout& layout, const core::vector2df& origin, f32 scale, video::SColor color, const core::rect<s32>* clip);
+			bool has_glyph_shaders() const;
+			video::E_MATERIAL_TYPE get_glyph_shader_material(bool distance_field, bool single_channel);
+			void disable_single_channel();
 
 			void createSharedPlane();
 
@@ -361,15 +795,133 @@ namespace gui
 			video::IVideoDriver* Driver;
 			io::path filename;
 			FT_Face tt_face;
-			FT_Size_Metrics font_metrics;
+
+			//! Our size object on tt_face.  Faces are shared between fonts, and each size keeps its own
+			//! scaled metrics, so switching between fonts of different sizes is just FT_Activate_Size().
+			FT_Size tt_size;
+			mutable SGUITTVerticalMetrics Vertical_Metrics;
 			FT_Int32 load_flags;
 
+			IGUITTPageUploader* Page_Uploader;
+
+			//! Renders batches of glyphs on worker threads.  Zero if disabled.
+			//! Batches smaller than RASTERIZER_MIN_BATCH are rendered on the calling thread, where
+			//! handing them to the workers would cost more than it saves.
+			enum { RASTERIZER_MIN_BATCH = 8 };
+			CGUITTGlyphRasterizer* Rasterizer;
+			u32 Rasterizer_Threads;
+
+			//! Asynchronous loading state.  Pending_Lookups counts lookups answered with a stand-in glyph,
+			//! so layouts and measurements can tell whether they used one.
+			bool Async_Loading;
+			uchar32_t Placeholder_Char;
+			u32 Commit_Budget;
+			u32 Commit_Frame_Count;
+			mutable u32 Async_Pending;
+			mutable u32 Pending_Lookups;
+
+			//! Frame counter used to find the least recently used glyphs.  Frame_Time is the device time
+			//! the current frame started at.
+			u32 Frame;
+			u32 Frame_Time;
+
 			mutable core::array<CGUITTGlyphPage*> Glyph_Pages;
-			mutable core::array<SGUITTGlyph> Glyphs;
+			u32 Page_Generation;
+			u32 Page_Budget;
+
+			//! The frame the pages were last trimmed to the budget in.
+			u32 Repack_Frame;
+
+			mutable CGUITTGlyphTable Glyphs;
+
+			//! A font consulted for characters this one doesn't have.
+			struct SFallbackFace
+			{
+				io::path filename;
+				FT_Face face;
+				FT_Size size;
+				CGUITTGlyphTable glyphs;
+			};
+
+			//! Glyph handles returned by getGlyphIndexByChar() keep the face in the top 8 bits: zero for our
+			//! own face, otherwise one more than the index into Fallback_Faces.  The rest is the glyph index.
+			enum { GLYPH_SLOT_SHIFT = 24, GLYPH_INDEX_MASK = 0xFFFFFF };
+			core::array<SFallbackFace*> Fallback_Faces;
+
+			//! Codepoint to glyph index lookups, with the replacement character already substituted.
+			//! Codepoints below CHAR_INDEX_TABLE_SIZE use a flat table, everything else uses the hash map.
+			enum { CHAR_INDEX_TABLE_SIZE = 0x3000, CHAR_INDEX_UNKNOWN = 0xFFFFFFFF };
+			mutable core::array<u32> Char_Index_Table;
+			mutable CGUITTHashMap<u32> Char_Index_Map;
+
+			//! Kerning in pixels between pairs of glyph indices, keyed by (previous << 32 | this).
+			//! The global kerning isn't included so it can change without invalidating the cache.
+			mutable CGUITTHashMap<core::vector2di> Kerning_Cache;
+
+			//! Least-recently-used cache of laid out strings.
+			mutable core::array<SGUITTTextLayout*> Layout_Cache;
+			mutable CGUITTHashMap<u32> Layout_Cache_Index;
+			u32 Layout_Cache_Size;
+			mutable u32 Layout_Cache_Tick;
+			mutable u32 Layout_Cache_Hits;
+			mutable u32 Layout_Cache_Misses;
+
+			//! Scratch space for laying out text, kept between calls so drawing doesn't allocate.
+			SGUITTTextLayout Scratch_Layout;
+			core::array<s32> Page_Batch;
+
+			//! Character positions for hit-testing text that isn't kept in the layout cache.
+			mutable SGUITTTextLayout Hit_Test_Layout;
+
+			//! Lines for measuring wrapped text that isn't kept in the layout cache.
+			mutable core::array<SGUITTTextLayout::SLine> Wrap_Lines;
+
+			//! Distance field state and scratch space.  Distance_Field_Grid holds the nearest seed offsets
+			//! of the distance transform, Distance_Field_Buffer the finished field.
+			u32 Distance_Field_Spread;
+			core::array<s32> Distance_Field_Grid;
+			core::array<u8> Distance_Field_Buffer;
+
+			//! If true, glyph pages are ECF_R8 textures.
+			bool Single_Channel;
+
+			//! Scratch space for drawing glyphs as textured quads.
+			core::array<video::S3DVertex> Quad_Vertices;
+			core::array<u16> Quad_Indices;
 
 			s32 GlobalKerningWidth;
 			s32 GlobalKerningHeight;
-			core::ustring Invisible;
+			CGUITTCharSet Invisible;
+	};
+
+	//! Draws the glyphs of a CGUITTFont at a different size.
+	//! Made by CGUITTFont::createScaledFont().  Kerning and invisible characters are shared with the original font.
+	class CGUITTScaledFont : public IGUIFont
+	{
+		public:
+			//! Constructor.  Grabs the font.
+			CGUITTScaledFont(CGUITTFont* font, f32 scale);
+
+			//! Destructor.  Drops the font.
+			virtual ~CGUITTScaledFont();
+
+			//! Returns the factor the original font's glyphs are scaled by.
+			f32 getScale() const { return Scale; }
+
+			virtual void draw(const core::stringw& text, const core::rect<s32>& position,
+				video::SColor color, bool hcenter=false, bool vcenter=false,
+				const core::rect<s32>* clip=0);
+			virtual core::dimension2d<u32> getDimension(const wchar_t* text) const;
+			virtual s32 getCharacterFromPos(const wchar_t* text, s32 pixel_x) const;
+			virtual void setKerningWidth(s32 kerning);
+			virtual void setKerningHeight(s32 kerning);
+			virtual s32 getKerningWidth(const wchar_t* thisLetter=0, const wchar_t* previousLetter=0) const;
+			virtual s32 getKerningHeight() const;
+			virtual void setInvisibleCharacters(const wchar_t *s);
+
+		private:
+			CGUITTFont* Font;
+			f32 Scale;
 	};
 
 } // end namespace gui
@@ -0,0 +1,106 @@
+/*
+   OpenGL glyph page uploader for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#include "CGUITTGLPageUploader.h"
+
+// Windows' GL headers stop at OpenGL 1.1, which has no glActiveTexture().  Whole pages are
+// uploaded there instead.
+#if defined(_IRR_COMPILE_WITH_OPENGL_) && !defined(_WIN32)
+	#define _CGUITT_GL_UPLOADS_
+	#ifdef __APPLE__
+		#include <OpenGL/gl.h>
+	#else
+		#include <GL/gl.h>
+	#endif
+#endif
+
+namespace irr
+{
+namespace gui
+{
+
+CGUITTGLPageUploader* CGUITTGLPageUploader::create(video::IVideoDriver* driver)
+{
+#ifdef _CGUITT_GL_UPLOADS_
+	if (driver && driver->getDriverType() == video::EDT_OPENGL)
+		return new CGUITTGLPageUploader(driver);
+#else
+	(void)driver;
+#endif
+	return 0;
+}
+
+bool CGUITTGLPageUploader::uploadRegion(video::ITexture* texture, const core::recti& region, const void* data, u32 pitch)
+{
+#ifdef _CGUITT_GL_UPLOADS_
+	// The formats Irrlicht's GL driver stores the page formats in.
+	GLenum format, type;
+	u32 bytes_per_pixel;
+	switch (texture->getColorFormat())
+	{
+		case video::ECF_R8:
+			format = GL_RED;
+			type = GL_UNSIGNED_BYTE;
+			bytes_per_pixel = 1;
+			break;
+		case video::ECF_A1R5G5B5:
+			format = GL_BGRA;
+			type = GL_UNSIGNED_SHORT_1_5_5_5_REV;
+			bytes_per_pixel = 2;
+			break;
+		case video::ECF_A8R8G8B8:
+			format = GL_BGRA;
+			type = GL_UNSIGNED_INT_8_8_8_8_REV;
+			bytes_per_pixel = 4;
+			break;
+		default:
+			return false;
+	}
+	if (region.getWidth() <= 0 || region.getHeight() <= 0 || pitch % bytes_per_pixel != 0)
+		return false;
+
+	// Have the driver bind the page.  The pixel is transparent, so nothing shows.
+	Driver->draw2DImage(texture, core::position2di(0, 0), core::recti(0, 0, 1, 1), 0, video::SColor(0, 255, 255, 255), true);
+
+	GLint active_unit, bound;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active_unit);
+	glActiveTexture(GL_TEXTURE0);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &bound);
+	if (!bound)
+	{
+		glActiveTexture(active_unit);
+		return false;
+	}
+
+	// Rows of the region are a full page row apart.
+	GLint alignment, row_length, skip_pixels, skip_rows;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glGetIntegerv(GL_UNPACK_ROW_LENGTH, &row_length);
+	glGetIntegerv(GL_UNPACK_SKIP_PIXELS, &skip_pixels);
+	glGetIntegerv(GL_UNPACK_SKIP_ROWS, &skip_rows);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / bytes_per_pixel);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+
+	for (u32 i = 0; i < 8 && glGetError() != GL_NO_ERROR; ++i) {}
+	glTexSubImage2D(GL_TEXTURE_2D, 0, region.UpperLeftCorner.X, region.UpperLeftCorner.Y,
+		region.getWidth(), region.getHeight(), format, type, data);
+	const bool uploaded = (glGetError() == GL_NO_ERROR);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length);
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, skip_pixels);
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, skip_rows);
+	glActiveTexture(active_unit);
+	return uploaded;
+#else
+	(void)texture; (void)region; (void)data; (void)pitch;
+	return false;
+#endif
+}
+
+} // end namespace gui
+} // end namespace irr
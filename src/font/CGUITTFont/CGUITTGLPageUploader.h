@@ -0,0 +1,39 @@
+/*
+   OpenGL glyph page uploader for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTGLPAGEUPLOADER_H_INCLUDED__
+#define __C_GUI_TTGLPAGEUPLOADER_H_INCLUDED__
+
+#include <irrlicht.h>
+#include "CGUITTFont.h"
+
+namespace irr
+{
+namespace gui
+{
+	//! Uploads the changed part of a glyph page with glTexSubImage2D.
+	//! Irrlicht keeps its GL texture names to itself, so the page is bound by drawing a fully
+	//! transparent pixel from it, then updated in place on the first texture unit.
+	//! CGUITTFont installs one of these by default on the OpenGL driver.
+	class CGUITTGLPageUploader : public IGUITTPageUploader
+	{
+		public:
+			//! Creates an uploader for the driver.
+			//! \return Zero if the driver isn't OpenGL or this build can't call OpenGL itself.
+			static CGUITTGLPageUploader* create(video::IVideoDriver* driver);
+
+			virtual bool uploadRegion(video::ITexture* texture, const core::recti& region, const void* data, u32 pitch);
+
+		private:
+			//! The driver isn't grabbed.  The font owning the uploader holds on to it.
+			CGUITTGLPageUploader(video::IVideoDriver* driver) : Driver(driver) {}
+
+			video::IVideoDriver* Driver;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTGLPAGEUPLOADER_H_INCLUDED__
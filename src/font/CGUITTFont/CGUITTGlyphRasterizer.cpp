@@ -0,0 +1,180 @@
+/*
+   Glyph rasterizing thread pool for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#include "CGUITTGlyphRasterizer.h"
+
+namespace irr
+{
+namespace gui
+{
+
+CGUITTGlyphRasterizer::CGUITTGlyphRasterizer(const FT_Byte* font_data, FT_Long font_data_size, const io::path& font_file, u32 pixel_size, u32 thread_count)
+: job_head(0), busy(0), generation(0), stopping(false)
+{
+	for (u32 i = 0; i < thread_count; ++i)
+	{
+		SWorker* worker = new SWorker();
+		if (FT_Init_FreeType(&worker->library))
+		{
+			delete worker;
+			break;
+		}
+
+		FT_Error error;
+		if (font_data)
+			error = FT_New_Memory_Face(worker->library, font_data, font_data_size, 0, &worker->face);
+		else
+			error = FT_New_Face(worker->library, reinterpret_cast<const char*>(font_file.c_str()), 0, &worker->face);
+
+		if (error)
+		{
+			FT_Done_FreeType(worker->library);
+			delete worker;
+			break;
+		}
+
+		FT_Set_Pixel_Sizes(worker->face, 0, pixel_size);
+		workers.push_back(worker);
+	}
+
+	// Start the threads only once all the workers exist, so the array isn't resized under them.
+	for (u32 i = 0; i < workers.size(); ++i)
+		workers[i]->thread = std::thread(&CGUITTGlyphRasterizer::run, this, workers[i]);
+}
+
+CGUITTGlyphRasterizer::~CGUITTGlyphRasterizer()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	job_ready.notify_all();
+
+	for (u32 i = 0; i < workers.size(); ++i)
+	{
+		SWorker* worker = workers[i];
+		worker->thread.join();
+		FT_Done_Face(worker->face);
+		FT_Done_FreeType(worker->library);
+		delete worker;
+	}
+}
+
+void CGUITTGlyphRasterizer::enqueue(u32 glyph_index, FT_Int32 load_flags)
+{
+	SJob job;
+	job.glyph_index = glyph_index;
+	job.load_flags = load_flags;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(job);
+	}
+	job_ready.notify_one();
+}
+
+void CGUITTGlyphRasterizer::rasterize(const core::array<u32>& glyph_indices, FT_Int32 load_flags, core::array<SGUITTRasterizedGlyph>& out)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		SJob job;
+		job.load_flags = load_flags;
+		for (u32 i = 0; i < glyph_indices.size(); ++i)
+		{
+			job.glyph_index = glyph_indices[i];
+			jobs.push_back(job);
+		}
+	}
+	job_ready.notify_all();
+
+	std::unique_lock<std::mutex> guard(lock);
+	while (job_head < jobs.size() || busy > 0)
+		job_done.wait(guard);
+
+	for (u32 i = 0; i < results.size(); ++i)
+		out.push_back(results[i]);
+	results.clear();
+}
+
+u32 CGUITTGlyphRasterizer::collect(core::array<SGUITTRasterizedGlyph>& out, u32 max_count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	const u32 count = core::min_(max_count, results.size());
+	for (u32 i = 0; i < count; ++i)
+		out.push_back(results[i]);
+	results.erase(0, count);
+	return count;
+}
+
+u32 CGUITTGlyphRasterizer::getPendingCount() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return jobs.size() - job_head + busy;
+}
+
+void CGUITTGlyphRasterizer::cancel()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	jobs.set_used(0);
+	job_head = 0;
+	results.clear();
+	++generation;
+}
+
+void CGUITTGlyphRasterizer::run(SWorker* worker)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		while (!stopping && job_head >= jobs.size())
+			job_ready.wait(guard);
+		if (stopping)
+			return;
+
+		const SJob job = jobs[job_head++];
+		if (job_head == jobs.size())
+		{
+			// Queue drained, so reuse its memory from the start.
+			jobs.set_used(0);
+			job_head = 0;
+		}
+		const u32 job_generation = generation;
+		++busy;
+		guard.unlock();
+
+		// Render outside the lock.  The face belongs to this worker only.
+		SGUITTRasterizedGlyph glyph;
+		glyph.glyph_index = job.glyph_index;
+		if (FT_Load_Glyph(worker->face, job.glyph_index, job.load_flags) == FT_Err_Ok)
+		{
+			FT_GlyphSlot slot = worker->face->glyph;
+			const FT_Bitmap& bits = slot->bitmap;
+			glyph.rendered = true;
+			glyph.advance = slot->advance;
+			glyph.left = slot->bitmap_left;
+			glyph.top = slot->bitmap_top;
+			glyph.width = bits.width;
+			glyph.rows = bits.rows;
+			glyph.pitch = bits.pitch;
+			glyph.pixel_mode = bits.pixel_mode;
+			glyph.num_grays = bits.num_grays;
+
+			// The slot is overwritten by the next load, so the pixels have to be copied.
+			const u32 size = core::abs_(bits.pitch) * bits.rows;
+			glyph.pixels.set_used(size);
+			if (size > 0)
+				memcpy(glyph.pixels.pointer(), bits.buffer, size);
+		}
+
+		guard.lock();
+		--busy;
+		if (job_generation == generation)
+			results.push_back(glyph);
+		if (job_head >= jobs.size() && busy == 0)
+			job_done.notify_all();
+	}
+}
+
+} // end namespace gui
+} // end namespace irr
@@ -0,0 +1,143 @@
+/*
+   Glyph rasterizing thread pool for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTGLYPHRASTERIZER_H_INCLUDED__
+#define __C_GUI_TTGLYPHRASTERIZER_H_INCLUDED__
+
+#include <irrlicht.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace irr
+{
+namespace gui
+{
+	//! A glyph bitmap rendered by a worker thread, waiting to be placed on a glyph page.
+	struct SGUITTRasterizedGlyph
+	{
+		SGUITTRasterizedGlyph() : glyph_index(0), rendered(false), left(0), top(0), width(0), rows(0), pitch(0), pixel_mode(0), num_grays(0)
+		{
+			advance.x = advance.y = 0;
+		}
+
+		//! Returns an FT_Bitmap describing the copied pixels.
+		FT_Bitmap getBitmap() const
+		{
+			FT_Bitmap bits;
+			memset(&bits, 0, sizeof(FT_Bitmap));
+			bits.rows = rows;
+			bits.width = width;
+			bits.pitch = pitch;
+			bits.buffer = const_cast<u8*>(pixels.const_pointer());
+			bits.num_grays = num_grays;
+			bits.pixel_mode = pixel_mode;
+			return bits;
+		}
+
+		u32 glyph_index;
+
+		//! False if FreeType failed to load the glyph.
+		bool rendered;
+
+		FT_Vector advance;
+		s32 left;
+		s32 top;
+		u32 width;
+		u32 rows;
+		s32 pitch;
+		u8 pixel_mode;
+		u16 num_grays;
+		core::array<u8> pixels;
+	};
+
+	//! Pool of worker threads that render glyph bitmaps in parallel.
+	//! FreeType objects can't be shared between threads, so every worker opens its own FT_Library
+	//! and FT_Face over the font data already in memory.  Workers only render; placing the bitmaps
+	//! on glyph pages and uploading them stays on the thread that owns the video driver.
+	class CGUITTGlyphRasterizer
+	{
+		public:
+			//! Starts the workers.
+			//! \param font_data The font file in memory.  It must stay valid while the rasterizer exists.
+			//! If zero, each worker opens font_file itself.
+			//! \param font_data_size The size of font_data in bytes.
+			//! \param font_file The path of the font file, used when font_data is zero.
+			//! \param pixel_size The pixel size glyphs are rendered at.
+			//! \param thread_count The number of workers to start.
+			CGUITTGlyphRasterizer(const FT_Byte* font_data, FT_Long font_data_size, const io::path& font_file, u32 pixel_size, u32 thread_count);
+
+			//! Stops the workers.  Queued glyphs are discarded.
+			~CGUITTGlyphRasterizer();
+
+			//! Returns the number of workers that started successfully.
+			u32 getThreadCount() const { return workers.size(); }
+
+			//! Queues a glyph to be rendered.  The result can be picked up later with collect().
+			void enqueue(u32 glyph_index, FT_Int32 load_flags);
+
+			//! Renders a set of glyphs across all workers and waits for them to finish.
+			//! \param glyph_indices The glyphs to render.
+			//! \param load_flags The FreeType loading flags.
+			//! \param out Receives the rendered glyphs, in no particular order.  Also receives the results of
+			//! any glyphs that were queued earlier with enqueue().
+			void rasterize(const core::array<u32>& glyph_indices, FT_Int32 load_flags, core::array<SGUITTRasterizedGlyph>& out);
+
+			//! Picks up finished glyphs without waiting.
+			//! \param out Finished glyphs are appended here.
+			//! \param max_count The most glyphs to pick up.
+			//! \return The number of glyphs appended.
+			u32 collect(core::array<SGUITTRasterizedGlyph>& out, u32 max_count = 0xFFFFFFFF);
+
+			//! Returns the number of glyphs that are queued or being rendered.
+			u32 getPendingCount() const;
+
+			//! Discards all queued and finished glyphs.  Glyphs being rendered right now are thrown away when done.
+			void cancel();
+
+		private:
+			struct SJob
+			{
+				u32 glyph_index;
+				FT_Int32 load_flags;
+			};
+
+			struct SWorker
+			{
+				SWorker() : library(0), face(0) {}
+				FT_Library library;
+				FT_Face face;
+				std::thread thread;
+			};
+
+			void run(SWorker* worker);
+
+			core::array<SWorker*> workers;
+
+			mutable std::mutex lock;
+			std::condition_variable job_ready;
+			std::condition_variable job_done;
+
+			//! Jobs waiting for a worker.  Entries before job_head have been taken.
+			core::array<SJob> jobs;
+			u32 job_head;
+
+			//! Number of jobs taken by workers but not finished.
+			u32 busy;
+
+			//! Bumped by cancel() so results of discarded jobs can be recognized.
+			u32 generation;
+
+			core::array<SGUITTRasterizedGlyph> results;
+			bool stopping;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTGLYPHRASTERIZER_H_INCLUDED__
@@ -0,0 +1,192 @@
+/*
+   Sparse glyph table for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTGLYPHTABLE_H_INCLUDED__
+#define __C_GUI_TTGLYPHTABLE_H_INCLUDED__
+
+#include <irrlicht.h>
+#include <cstring>
+
+namespace irr
+{
+namespace gui
+{
+	//! Bookkeeping for a single TrueType glyph.  Its metrics are kept in CGUITTGlyphTable.
+	struct SGUITTGlyph
+	{
+		//! Constructor.
+		SGUITTGlyph() : isLoaded(false), isPending(false), last_used(0), use_count(0) {}
+
+		//! Unloads the glyph.  Its place on the glyph page is given up.
+		void unload()
+		{
+			isLoaded = false;
+			isPending = false;
+		}
+
+		//! Marks the glyph as used in a frame.
+		void touch(u32 frame)
+		{
+			if (last_used != frame)
+			{
+				last_used = frame;
+				++use_count;
+			}
+		}
+
+		//! If true, the glyph has been loaded.
+		bool isLoaded;
+
+		//! If true, the glyph is being rendered in the background and isn't loaded yet.
+		bool isPending;
+
+		//! The font's frame number when the glyph was last looked up or drawn.
+		u32 last_used;
+
+		//! The number of frames the glyph was used in, for CGUITTFont::saveGlyphManifest().
+		//! Kept when the glyph is unloaded.
+		u32 use_count;
+	};
+
+	//! The glyphs of one face.
+	//! Glyphs are stored in blocks of BLOCK_SIZE, and a block is only allocated once one of its glyphs is
+	//! used, so a CJK face with tens of thousands of glyphs only costs memory for the blocks text touches.
+	//! Inside a block every metric is its own array of 16-bit values, so measuring text only reads advances.
+	class CGUITTGlyphTable
+	{
+		public:
+			enum { BLOCK_SHIFT = 7, BLOCK_SIZE = 1 << BLOCK_SHIFT, BLOCK_MASK = BLOCK_SIZE - 1 };
+
+			CGUITTGlyphTable() : count(0) {}
+
+			~CGUITTGlyphTable() { resize(0); }
+
+			//! Sets the number of glyphs.  Every glyph is forgotten.
+			void resize(u32 glyph_count)
+			{
+				for (u32 i = 0; i < blocks.size(); ++i)
+					delete blocks[i];
+				blocks.clear();
+
+				count = glyph_count;
+				const u32 block_count = (glyph_count + BLOCK_MASK) >> BLOCK_SHIFT;
+				blocks.reallocate(block_count);
+				for (u32 i = 0; i < block_count; ++i)
+					blocks.push_back(0);
+			}
+
+			//! Returns the number of glyphs.
+			u32 size() const { return count; }
+
+			//! Returns a glyph, allocating its block if none of its glyphs were used before.
+			SGUITTGlyph& operator[](u32 index)
+			{
+				SBlock*& block = blocks[index >> BLOCK_SHIFT];
+				if (!block)
+					block = new SBlock();
+				return block->glyphs[index & BLOCK_MASK];
+			}
+
+			//! Returns a glyph, or zero if none of the glyphs in its block were used.
+			SGUITTGlyph* find(u32 index)
+			{
+				SBlock* block = blocks[index >> BLOCK_SHIFT];
+				return block ? &block->glyphs[index & BLOCK_MASK] : 0;
+			}
+
+			const SGUITTGlyph* find(u32 index) const
+			{
+				const SBlock* block = blocks[index >> BLOCK_SHIFT];
+				return block ? &block->glyphs[index & BLOCK_MASK] : 0;
+			}
+
+			//! The metrics below belong to a glyph that was looked up with operator[] before.
+
+			//! Returns the horizontal advance in pixels.
+			s32 getAdvance(u32 index) const { return blocks[index >> BLOCK_SHIFT]->advance[index & BLOCK_MASK]; }
+
+			//! Returns the bitmap offset: the left bearing, and the top bearing counted upwards.
+			core::vector2di getOffset(u32 index) const
+			{
+				const SBlock* block = blocks[index >> BLOCK_SHIFT];
+				const u32 i = index & BLOCK_MASK;
+				return core::vector2di(block->offset_x[i], block->offset_y[i]);
+			}
+
+			//! Returns the source rectangle on the glyph page.
+			core::recti getSourceRect(u32 index) const
+			{
+				const SBlock* block = blocks[index >> BLOCK_SHIFT];
+				const u32 i = index & BLOCK_MASK;
+				return core::recti(core::position2di(block->rect_x[i], block->rect_y[i]),
+					core::dimension2di(block->rect_width[i], block->rect_height[i]));
+			}
+
+			//! Returns the height of the source rectangle.
+			s32 getHeight(u32 index) const { return blocks[index >> BLOCK_SHIFT]->rect_height[index & BLOCK_MASK]; }
+
+			//! Returns the index of the glyph page the glyph is on.
+			u32 getPage(u32 index) const { return blocks[index >> BLOCK_SHIFT]->page[index & BLOCK_MASK]; }
+
+			//! Sets the advance and bitmap offset.
+			void setMetrics(u32 index, s32 advance, const core::vector2di& offset)
+			{
+				SBlock* block = blocks[index >> BLOCK_SHIFT];
+				const u32 i = index & BLOCK_MASK;
+				block->advance[i] = (s16)advance;
+				block->offset_x[i] = (s16)offset.X;
+				block->offset_y[i] = (s16)offset.Y;
+			}
+
+			//! Sets where the glyph is on the glyph pages.
+			void setPlacement(u32 index, u32 page, const core::recti& source_rect)
+			{
+				SBlock* block = blocks[index >> BLOCK_SHIFT];
+				const u32 i = index & BLOCK_MASK;
+				block->page[i] = (u16)page;
+				block->rect_x[i] = (u16)source_rect.UpperLeftCorner.X;
+				block->rect_y[i] = (u16)source_rect.UpperLeftCorner.Y;
+				block->rect_width[i] = (u16)source_rect.getWidth();
+				block->rect_height[i] = (u16)source_rect.getHeight();
+			}
+
+		private:
+			// Not copyable.
+			CGUITTGlyphTable(const CGUITTGlyphTable&);
+			CGUITTGlyphTable& operator=(const CGUITTGlyphTable&);
+
+			struct SBlock
+			{
+				SBlock()
+				{
+					memset(advance, 0, sizeof(advance));
+					memset(offset_x, 0, sizeof(offset_x));
+					memset(offset_y, 0, sizeof(offset_y));
+					memset(rect_x, 0, sizeof(rect_x));
+					memset(rect_y, 0, sizeof(rect_y));
+					memset(rect_width, 0, sizeof(rect_width));
+					memset(rect_height, 0, sizeof(rect_height));
+					memset(page, 0, sizeof(page));
+				}
+
+				s16 advance[BLOCK_SIZE];
+				s16 offset_x[BLOCK_SIZE];
+				s16 offset_y[BLOCK_SIZE];
+				u16 rect_x[BLOCK_SIZE];
+				u16 rect_y[BLOCK_SIZE];
+				u16 rect_width[BLOCK_SIZE];
+				u16 rect_height[BLOCK_SIZE];
+				u16 page[BLOCK_SIZE];
+				SGUITTGlyph glyphs[BLOCK_SIZE];
+			};
+
+			core::array<SBlock*> blocks;
+			u32 count;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTGLYPHTABLE_H_INCLUDED__
@@ -0,0 +1,170 @@
+/*
+   Lookup cache container for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTHASHMAP_H_INCLUDED__
+#define __C_GUI_TTHASHMAP_H_INCLUDED__
+
+#include <irrlicht.h>
+
+namespace irr
+{
+namespace gui
+{
+	//! Small open-addressing hash map used by CGUITTFont's lookup caches.
+	//! Keys are 64-bit integers (codepoints, glyph pairs, string hashes).  Irrlicht's core::map is a
+	//! red-black tree that allocates a node per entry, which is too slow for per-character lookups.
+	template <class V>
+	class CGUITTHashMap
+	{
+		public:
+			CGUITTHashMap() : count(0) {}
+
+			//! Returns a pointer to the value stored for the key, or zero if there is none.
+			V* find(const u64 key) const
+			{
+				if (count == 0)
+					return 0;
+
+				const u32 mask = entries.size() - 1;
+				for (u32 i = hash(key) & mask; ; i = (i + 1) & mask)
+				{
+					const SEntry& e = entries[i];
+					if (!e.used)
+						return 0;
+					if (e.key == key)
+						return const_cast<V*>(&e.value);
+				}
+			}
+
+			//! Stores a value for the key, replacing any previous value.
+			//! \return A reference to the stored value.
+			V& set(const u64 key, const V& value)
+			{
+				// Keep the table at most half full so probe chains stay short.
+				if ((count + 1) * 2 > entries.size())
+					grow();
+
+				const u32 mask = entries.size() - 1;
+				u32 i = hash(key) & mask;
+				while (entries[i].used && entries[i].key != key)
+					i = (i + 1) & mask;
+
+				SEntry& e = entries[i];
+				if (!e.used)
+				{
+					e.used = true;
+					e.key = key;
+					++count;
+				}
+				e.value = value;
+				return e.value;
+			}
+
+			//! Removes the key from the map.
+			//! \return False if the key wasn't in the map.
+			bool remove(const u64 key)
+			{
+				if (count == 0)
+					return false;
+
+				const u32 mask = entries.size() - 1;
+				u32 i = hash(key) & mask;
+				for (;;)
+				{
+					if (!entries[i].used)
+						return false;
+					if (entries[i].key == key)
+						break;
+					i = (i + 1) & mask;
+				}
+
+				// Shift the following entries of the probe chain back so lookups don't stop early.
+				u32 hole = i;
+				for (u32 j = (i + 1) & mask; entries[j].used; j = (j + 1) & mask)
+				{
+					const u32 home = hash(entries[j].key) & mask;
+					const bool between = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+					if (!between)
+					{
+						entries[hole] = entries[j];
+						hole = j;
+					}
+				}
+				entries[hole].used = false;
+				entries[hole].value = V();
+				--count;
+				return true;
+			}
+
+			//! Removes all entries but keeps the allocated table.
+			void clear()
+			{
+				for (u32 i = 0; i < entries.size(); ++i)
+				{
+					entries[i].used = false;
+					entries[i].value = V();
+				}
+				count = 0;
+			}
+
+			//! Returns the number of stored entries.
+			u32 size() const { return count; }
+
+			//! Calls visitor(key, value) for every entry, in no particular order.
+			template <class F>
+			void visit(F& visitor) const
+			{
+				for (u32 i = 0; i < entries.size(); ++i)
+				{
+					if (entries[i].used)
+						visitor(entries[i].key, entries[i].value);
+				}
+			}
+
+		private:
+			struct SEntry
+			{
+				SEntry() : key(0), used(false) {}
+				u64 key;
+				V value;
+				bool used;
+			};
+
+			//! 64-bit mixing function, so that sequential keys spread over the table.
+			static u32 hash(u64 key)
+			{
+				key ^= key >> 33;
+				key *= 0xff51afd7ed558ccdULL;
+				key ^= key >> 33;
+				key *= 0xc4ceb9fe1a85ec53ULL;
+				key ^= key >> 33;
+				return (u32)key;
+			}
+
+			void grow()
+			{
+				core::array<SEntry> old(entries);
+				const u32 new_size = entries.size() ? entries.size() * 2 : 16;
+				entries.clear();
+				entries.reallocate(new_size);
+				for (u32 i = 0; i < new_size; ++i)
+					entries.push_back(SEntry());
+				count = 0;
+
+				for (u32 i = 0; i < old.size(); ++i)
+				{
+					if (old[i].used)
+						set(old[i].key, old[i].value);
+				}
+			}
+
+			core::array<SEntry> entries;
+			u32 count;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTHASHMAP_H_INCLUDED__
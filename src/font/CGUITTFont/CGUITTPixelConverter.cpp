@@ -0,0 +1,225 @@
+/*
+   Glyph bitmap conversion kernels for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#include "CGUITTPixelConverter.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define _CGUITT_X86_KERNELS_
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions for functions that ask for them, which keeps the rest
+// of the file runnable on any x86 CPU.  MSVC always allows the intrinsics.
+#if defined(__GNUC__) || defined(__clang__)
+	#define _CGUITT_TARGET_SSE2_ __attribute__((target("sse2")))
+	#define _CGUITT_TARGET_AVX2_ __attribute__((target("avx2")))
+#else
+	#define _CGUITT_TARGET_SSE2_
+	#define _CGUITT_TARGET_AVX2_
+#endif
+
+namespace irr
+{
+namespace gui
+{
+
+namespace
+{
+	// Glyph pages are filled with transparent white, so every texel carries white color bits.
+	const u32 ARGB_WHITE = 0x00FFFFFF;
+	const u16 A1R5G5B5_CLEAR = 0x7FFF;
+	const u16 A1R5G5B5_SET = 0xFFFF;
+
+	void grayToA8R8G8B8_scalar(u32* dest, const u8* src, u32 count)
+	{
+		for (u32 i = 0; i < count; ++i)
+			dest[i] = ((u32)src[i] << 24) | ARGB_WHITE;
+	}
+
+	void monoToA1R5G5B5_scalar(u16* dest, const u8* src, u32 count)
+	{
+		for (u32 i = 0; i < count; ++i)
+			dest[i] = (src[i >> 3] & (0x80 >> (i & 7))) ? A1R5G5B5_SET : A1R5G5B5_CLEAR;
+	}
+
+	void monoToR8_scalar(u8* dest, const u8* src, u32 count)
+	{
+		for (u32 i = 0; i < count; ++i)
+			dest[i] = (src[i >> 3] & (0x80 >> (i & 7))) ? 255 : 0;
+	}
+
+#ifdef _CGUITT_X86_KERNELS_
+	_CGUITT_TARGET_SSE2_ void grayToA8R8G8B8_sse2(u32* dest, const u8* src, u32 count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i white = _mm_set1_epi32(ARGB_WHITE);
+		u32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			// Interleaving with zeros twice moves each byte to the top of its own 32-bit lane.
+			const __m128i gray = _mm_loadu_si128((const __m128i*)(src + i));
+			const __m128i lo = _mm_unpacklo_epi8(zero, gray);
+			const __m128i hi = _mm_unpackhi_epi8(zero, gray);
+			_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(_mm_unpacklo_epi16(zero, lo), white));
+			_mm_storeu_si128((__m128i*)(dest + i + 4), _mm_or_si128(_mm_unpackhi_epi16(zero, lo), white));
+			_mm_storeu_si128((__m128i*)(dest + i + 8), _mm_or_si128(_mm_unpacklo_epi16(zero, hi), white));
+			_mm_storeu_si128((__m128i*)(dest + i + 12), _mm_or_si128(_mm_unpackhi_epi16(zero, hi), white));
+		}
+		grayToA8R8G8B8_scalar(dest + i, src + i, count - i);
+	}
+
+	_CGUITT_TARGET_SSE2_ void monoToA1R5G5B5_sse2(u16* dest, const u8* src, u32 count)
+	{
+		// Lane n tests bit 0x80 >> n.
+		const __m128i bits = _mm_set_epi16(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+		const __m128i clear = _mm_set1_epi16((short)A1R5G5B5_CLEAR);
+		u32 i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i byte = _mm_set1_epi16(src[i >> 3]);
+			const __m128i set = _mm_cmpeq_epi16(_mm_and_si128(byte, bits), bits);
+			_mm_storeu_si128((__m128i*)(dest + i), _mm_or_si128(set, clear));
+		}
+		monoToA1R5G5B5_scalar(dest + i, src + (i >> 3), count - i);
+	}
+
+	_CGUITT_TARGET_SSE2_ void monoToR8_sse2(u8* dest, const u8* src, u32 count)
+	{
+		const __m128i bits = _mm_set_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+			0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+		u32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			// The first eight lanes test the first byte, the last eight the second.
+			const __m128i bytes = _mm_unpacklo_epi64(_mm_set1_epi8((char)src[i >> 3]), _mm_set1_epi8((char)src[(i >> 3) + 1]));
+			_mm_storeu_si128((__m128i*)(dest + i), _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits));
+		}
+		monoToR8_scalar(dest + i, src + (i >> 3), count - i);
+	}
+
+	_CGUITT_TARGET_AVX2_ void grayToA8R8G8B8_avx2(u32* dest, const u8* src, u32 count)
+	{
+		const __m256i white = _mm256_set1_epi32(ARGB_WHITE);
+		u32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const __m256i lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+			const __m256i hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+			_mm256_storeu_si256((__m256i*)(dest + i), _mm256_or_si256(_mm256_slli_epi32(lo, 24), white));
+			_mm256_storeu_si256((__m256i*)(dest + i + 8), _mm256_or_si256(_mm256_slli_epi32(hi, 24), white));
+		}
+		grayToA8R8G8B8_scalar(dest + i, src + i, count - i);
+	}
+
+	_CGUITT_TARGET_AVX2_ void monoToA1R5G5B5_avx2(u16* dest, const u8* src, u32 count)
+	{
+		// Two source bytes per step.  The low eight lanes test the first byte, the high eight the second.
+		const __m256i bits = _mm256_set_epi16(
+			0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, (short)0x8000,
+			0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+		const __m256i clear = _mm256_set1_epi16((short)A1R5G5B5_CLEAR);
+		u32 i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			const u8* p = src + (i >> 3);
+			const __m256i bytes = _mm256_set1_epi16((short)(p[0] | (p[1] << 8)));
+			const __m256i set = _mm256_cmpeq_epi16(_mm256_and_si256(bytes, bits), bits);
+			_mm256_storeu_si256((__m256i*)(dest + i), _mm256_or_si256(set, clear));
+		}
+		monoToA1R5G5B5_sse2(dest + i, src + (i >> 3), count - i);
+	}
+
+	_CGUITT_TARGET_AVX2_ void monoToR8_avx2(u8* dest, const u8* src, u32 count)
+	{
+		// Four source bytes per step.  Both 128-bit halves hold all four bytes, so the in-lane shuffle
+		// can spread bytes 0 and 1 over the low half and bytes 2 and 3 over the high half.
+		const __m256i spread = _mm256_set_epi8(
+			3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+			1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i bits = _mm256_set1_epi64x((long long)0x0102040810204080ULL);
+		u32 i = 0;
+		for (; i + 32 <= count; i += 32)
+		{
+			const u8* p = src + (i >> 3);
+			const s32 packed = (s32)(p[0] | (p[1] << 8) | (p[2] << 16) | ((u32)p[3] << 24));
+			const __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(packed), spread);
+			_mm256_storeu_si256((__m256i*)(dest + i), _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits));
+		}
+		monoToR8_sse2(dest + i, src + (i >> 3), count - i);
+	}
+
+	bool cpu_has_avx2()
+	{
+	#if defined(_MSC_VER)
+		// AVX2 needs the CPU to have it and the OS to save the YMM registers.
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+	#endif
+	}
+#endif // _CGUITT_X86_KERNELS_
+
+	const SGUITTPixelConverter c_converters[EGPK_COUNT] =
+	{
+		{ grayToA8R8G8B8_scalar, monoToA1R5G5B5_scalar, monoToR8_scalar, EGPK_SCALAR, "scalar" },
+	#ifdef _CGUITT_X86_KERNELS_
+		{ grayToA8R8G8B8_sse2, monoToA1R5G5B5_sse2, monoToR8_sse2, EGPK_SSE2, "sse2" },
+		{ grayToA8R8G8B8_avx2, monoToA1R5G5B5_avx2, monoToR8_avx2, EGPK_AVX2, "avx2" }
+	#else
+		{ grayToA8R8G8B8_scalar, monoToA1R5G5B5_scalar, monoToR8_scalar, EGPK_SCALAR, "scalar" },
+		{ grayToA8R8G8B8_scalar, monoToA1R5G5B5_scalar, monoToR8_scalar, EGPK_SCALAR, "scalar" }
+	#endif
+	};
+}
+
+bool SGUITTPixelConverter::isSupported(E_GUITT_PIXEL_KERNEL kernel)
+{
+	switch (kernel)
+	{
+		case EGPK_SCALAR:
+			return true;
+	#ifdef _CGUITT_X86_KERNELS_
+		// Every CPU this file builds the x86 kernels for has SSE2.
+		case EGPK_SSE2:
+			return true;
+		case EGPK_AVX2:
+		{
+			static const bool has_avx2 = cpu_has_avx2();
+			return has_avx2;
+		}
+	#endif
+		default:
+			return false;
+	}
+}
+
+const SGUITTPixelConverter& SGUITTPixelConverter::get(E_GUITT_PIXEL_KERNEL kernel)
+{
+	return isSupported(kernel) ? c_converters[kernel] : c_converters[EGPK_SCALAR];
+}
+
+const SGUITTPixelConverter& SGUITTPixelConverter::get()
+{
+	static const SGUITTPixelConverter& best =
+		isSupported(EGPK_AVX2) ? c_converters[EGPK_AVX2] : get(EGPK_SSE2);
+	return best;
+}
+
+} // end namespace gui
+} // end namespace irr
@@ -0,0 +1,57 @@
+/*
+   Glyph bitmap conversion kernels for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTPIXELCONVERTER_H_INCLUDED__
+#define __C_GUI_TTPIXELCONVERTER_H_INCLUDED__
+
+#include <irrlicht.h>
+
+namespace irr
+{
+namespace gui
+{
+	//! Instruction sets the conversion kernels are written for.
+	enum E_GUITT_PIXEL_KERNEL
+	{
+		EGPK_SCALAR = 0,
+		EGPK_SSE2,
+		EGPK_AVX2,
+		EGPK_COUNT
+	};
+
+	//! Row conversion kernels that copy FreeType bitmaps into glyph images.
+	//! Each kernel converts one row and writes every pixel of it, so the destination doesn't need to be
+	//! cleared first.  The fastest set the CPU supports is picked at runtime.
+	struct SGUITTPixelConverter
+	{
+		//! Expands 256 level coverage to white ECF_A8R8G8B8 texels with the coverage as alpha.
+		void (*grayToA8R8G8B8)(u32* dest, const u8* src, u32 count);
+
+		//! Expands 1-bit pixels, most significant bit first, to white ECF_A1R5G5B5 texels.
+		void (*monoToA1R5G5B5)(u16* dest, const u8* src, u32 count);
+
+		//! Expands 1-bit pixels, most significant bit first, to ECF_R8 coverage of 0 or 255.
+		void (*monoToR8)(u8* dest, const u8* src, u32 count);
+
+		//! The kernel set these functions belong to.
+		E_GUITT_PIXEL_KERNEL kernel;
+
+		//! Name of the kernel set, for benchmarks and logs.
+		const c8* name;
+
+		//! Returns the fastest kernels the CPU supports.
+		static const SGUITTPixelConverter& get();
+
+		//! Returns a particular set of kernels.  Falls back to the scalar kernels if the CPU doesn't support it.
+		static const SGUITTPixelConverter& get(E_GUITT_PIXEL_KERNEL kernel);
+
+		//! Returns true if the CPU can run the given kernels.
+		static bool isSupported(E_GUITT_PIXEL_KERNEL kernel);
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTPIXELCONVERTER_H_INCLUDED__
@@ -0,0 +1,208 @@
+/*
+   Text scene node for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#include "CGUITTTextSceneNode.h"
+#include "CGUITTFont.h"
+
+namespace irr
+{
+namespace gui
+{
+
+CGUITTTextSceneNode::CGUITTTextSceneNode(CGUITTFont* font, const wchar_t* text, video::SColor color, bool center,
+	scene::ISceneNode* parent, scene::ISceneManager* mgr, s32 id, const core::vector3df& position)
+: scene::ISceneNode(parent, mgr, id, position), Font(font), Text(text), Color(color), Center(center),
+Used_Buffers(0), Layout(new SGUITTTextLayout()), Needs_Rebuild(true), Font_Generation(0)
+{
+	#ifdef _DEBUG
+	setDebugName("CGUITTTextSceneNode");
+	#endif
+
+	Font->grab();
+	rebuild();
+}
+
+CGUITTTextSceneNode::~CGUITTTextSceneNode()
+{
+	for (u32 i = 0; i < Buffers.size(); ++i)
+		Buffers[i].buffer->drop();
+	delete Layout;
+	Font->drop();
+}
+
+void CGUITTTextSceneNode::setText(const wchar_t* text)
+{
+	Text = text;
+	rebuild();
+}
+
+void CGUITTTextSceneNode::setTextColor(video::SColor color)
+{
+	Color = color;
+	for (u32 i = 0; i < Used_Buffers; ++i)
+	{
+		scene::SMeshBuffer* buffer = Buffers[i].buffer;
+		for (u32 j = 0; j < buffer->Vertices.size(); ++j)
+			buffer->Vertices[j].Color = color;
+		buffer->setDirty(scene::EBT_VERTEX);
+	}
+}
+
+void CGUITTTextSceneNode::OnRegisterSceneNode()
+{
+	if (IsVisible)
+	{
+		// The first node of the frame commits glyphs and repacks the pages, so no glyphs move
+		// while the rest register.
+		Font->prepareFrame();
+
+		// Pick up glyphs that were still loading, or that moved since we were built.
+		if (Needs_Rebuild || Font_Generation != Font->getPageGeneration())
+			rebuild();
+
+		if (Used_Buffers > 0)
+			SceneManager->registerNodeForRendering(this, scene::ESNRP_TRANSPARENT);
+	}
+
+	ISceneNode::OnRegisterSceneNode();
+}
+
+void CGUITTTextSceneNode::render()
+{
+	video::IVideoDriver* driver = SceneManager->getVideoDriver();
+	driver->setTransform(video::ETS_WORLD, AbsoluteTransformation);
+
+	for (u32 i = 0; i < Used_Buffers; ++i)
+	{
+		scene::SMeshBuffer* buffer = Buffers[i].buffer;
+
+		// The page texture can change when glyphs are added, so fetch it at draw time.
+		buffer->Material.setTexture(0, Font->getPageTextureByIndex(Buffers[i].page));
+		driver->setMaterial(buffer->Material);
+		driver->drawMeshBuffer(buffer);
+	}
+}
+
+video::SMaterial& CGUITTTextSceneNode::getMaterial(u32 i)
+{
+	return Buffers[i].buffer->Material;
+}
+
+scene::SMeshBuffer* CGUITTTextSceneNode::next_buffer(u32 page)
+{
+	if (Used_Buffers == Buffers.size())
+	{
+		SPageBuffer entry;
+		entry.buffer = new scene::SMeshBuffer();
+		entry.buffer->setHardwareMappingHint(scene::EHM_STATIC);
+		Buffers.push_back(entry);
+	}
+
+	SPageBuffer& entry = Buffers[Used_Buffers++];
+	entry.page = page;
+	entry.buffer->Vertices.set_used(0);
+	entry.buffer->Indices.set_used(0);
+	return entry.buffer;
+}
+
+void CGUITTTextSceneNode::rebuild()
+{
+	Needs_Rebuild = !Font->getTextLayout(Text, *Layout);
+	Font_Generation = Font->getPageGeneration();
+	Used_Buffers = 0;
+
+	// The layout has Y pointing down from the upper left corner.  Flip it and center it if wanted.
+	core::vector2df shift(0.f, 0.f);
+	if (Center)
+	{
+		shift.X = -(f32)Layout->dimension.Width * 0.5f;
+		shift.Y = (f32)Layout->dimension.Height * 0.5f;
+	}
+
+	video::SMaterial material;
+	material.MaterialType = Font->getGlyphMaterialType();
+	material.Lighting = false;
+	material.setFlag(video::EMF_ZWRITE_ENABLE, false);
+	material.BackfaceCulling = false;
+	material.TextureLayer[0].BilinearFilter = true;
+	material.TextureLayer[0].TextureWrapU = video::ETC_CLAMP_TO_EDGE;
+	material.TextureLayer[0].TextureWrapV = video::ETC_CLAMP_TO_EDGE;
+
+	bool have_box = false;
+	for (u32 i = 0; i < Layout->batch_count; ++i)
+	{
+		const SGUITTTextLayout::SBatch& batch = Layout->batches[i];
+		video::ITexture* texture = Font->getPageTextureByIndex(batch.page);
+		if (!texture || batch.positions.size() == 0)
+			continue;
+
+		const core::dimension2du& page_size = texture->getOriginalSize();
+		const f32 inv_width = 1.f / page_size.Width;
+		const f32 inv_height = 1.f / page_size.Height;
+
+		scene::SMeshBuffer* buffer = next_buffer(batch.page);
+		buffer->Material = material;
+		buffer->Material.setTexture(0, texture);
+		buffer->Vertices.reallocate(core::min_(batch.positions.size(), 0x3FFFu) * 4);
+		buffer->Indices.reallocate(core::min_(batch.positions.size(), 0x3FFFu) * 6);
+
+		for (u32 j = 0; j < batch.positions.size(); ++j)
+		{
+			// 16-bit indices only reach so far; carry on in another buffer for the same page.
+			if (buffer->Vertices.size() > 0xFFFF - 4)
+			{
+				buffer->recalculateBoundingBox();
+				buffer = next_buffer(batch.page);
+				buffer->Material = material;
+				buffer->Material.setTexture(0, texture);
+			}
+
+			const core::recti& source = batch.source_rects[j];
+			const f32 x0 = batch.positions[j].X - Layout->origin.X + shift.X;
+			const f32 y0 = -(f32)(batch.positions[j].Y - Layout->origin.Y) + shift.Y;
+			const f32 x1 = x0 + source.getWidth();
+			const f32 y1 = y0 - source.getHeight();
+			const f32 u0 = source.UpperLeftCorner.X * inv_width;
+			const f32 v0 = source.UpperLeftCorner.Y * inv_height;
+			const f32 u1 = source.LowerRightCorner.X * inv_width;
+			const f32 v1 = source.LowerRightCorner.Y * inv_height;
+
+			const u16 first = (u16)buffer->Vertices.size();
+			buffer->Vertices.push_back(video::S3DVertex(x0, y0, 0.f, 0.f, 0.f, -1.f, Color, u0, v0));
+			buffer->Vertices.push_back(video::S3DVertex(x1, y0, 0.f, 0.f, 0.f, -1.f, Color, u1, v0));
+			buffer->Vertices.push_back(video::S3DVertex(x1, y1, 0.f, 0.f, 0.f, -1.f, Color, u1, v1));
+			buffer->Vertices.push_back(video::S3DVertex(x0, y1, 0.f, 0.f, 0.f, -1.f, Color, u0, v1));
+			buffer->Indices.push_back(first);
+			buffer->Indices.push_back(first + 1);
+			buffer->Indices.push_back(first + 2);
+			buffer->Indices.push_back(first);
+			buffer->Indices.push_back(first + 2);
+			buffer->Indices.push_back(first + 3);
+
+			if (have_box)
+			{
+				Box.addInternalPoint(core::vector3df(x0, y0, 0.f));
+				Box.addInternalPoint(core::vector3df(x1, y1, 0.f));
+			}
+			else
+			{
+				Box.reset(x0, y0, 0.f);
+				Box.addInternalPoint(core::vector3df(x1, y1, 0.f));
+				have_box = true;
+			}
+		}
+
+		buffer->recalculateBoundingBox();
+	}
+
+	if (!have_box)
+		Box.reset(0.f, 0.f, 0.f);
+
+	for (u32 i = 0; i < Used_Buffers; ++i)
+		Buffers[i].buffer->setDirty();
+}
+
+} // end namespace gui
+} // end namespace irr
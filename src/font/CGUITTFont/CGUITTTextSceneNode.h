@@ -0,0 +1,89 @@
+/*
+   Text scene node for CGUITTFont.
+   Distributed under the same license as CGUITTFont.h.
+*/
+
+#ifndef __C_GUI_TTTEXTSCENENODE_H_INCLUDED__
+#define __C_GUI_TTTEXTSCENENODE_H_INCLUDED__
+
+#include <irrlicht.h>
+
+namespace irr
+{
+namespace gui
+{
+	class CGUITTFont;
+	struct SGUITTTextLayout;
+
+	//! Scene node that draws a string of CGUITTFont text in the 3D world.
+	//! All the glyphs on one glyph page go into a single mesh buffer, so a label costs one draw call
+	//! per page instead of one scene node per character.  The text is laid out in the XY plane, one
+	//! unit per pixel, with Y pointing up.
+	class CGUITTTextSceneNode : public scene::ISceneNode
+	{
+		public:
+			//! Constructor.  Grabs the font.
+			//! \param center If true, the text is centered on the node's position.  Otherwise the node's
+			//! position is the upper left corner of the text.
+			CGUITTTextSceneNode(CGUITTFont* font, const wchar_t* text, video::SColor color, bool center,
+				scene::ISceneNode* parent, scene::ISceneManager* mgr, s32 id = -1,
+				const core::vector3df& position = core::vector3df(0, 0, 0));
+
+			//! Destructor.  Drops the font and the mesh buffers.
+			virtual ~CGUITTTextSceneNode();
+
+			//! Changes the text.  The mesh buffers are rebuilt in place, keeping their memory.
+			virtual void setText(const wchar_t* text);
+
+			//! Returns the text.
+			const core::stringw& getText() const { return Text; }
+
+			//! Changes the color of the text.
+			virtual void setTextColor(video::SColor color);
+
+			//! Returns the color of the text.
+			video::SColor getTextColor() const { return Color; }
+
+			virtual void OnRegisterSceneNode();
+			virtual void render();
+			virtual const core::aabbox3d<f32>& getBoundingBox() const { return Box; }
+			virtual u32 getMaterialCount() const { return Used_Buffers; }
+			virtual video::SMaterial& getMaterial(u32 i);
+
+		private:
+			//! A mesh buffer and the glyph page its quads come from.
+			struct SPageBuffer
+			{
+				u32 page;
+				scene::SMeshBuffer* buffer;
+			};
+
+			//! Lays the text out again and refills the mesh buffers.
+			void rebuild();
+
+			//! Returns an empty buffer for the page, reusing an earlier one if there is one.
+			scene::SMeshBuffer* next_buffer(u32 page);
+
+			CGUITTFont* Font;
+			core::stringw Text;
+			video::SColor Color;
+			bool Center;
+
+			//! Buffers are kept when the text shrinks; only the first Used_Buffers are drawn.
+			core::array<SPageBuffer> Buffers;
+			u32 Used_Buffers;
+
+			//! Layout of the text, kept so its memory is reused by rebuild().
+			SGUITTTextLayout* Layout;
+
+			//! True if glyphs were still loading when the text was laid out, or the font has been reset since.
+			bool Needs_Rebuild;
+			u32 Font_Generation;
+
+			core::aabbox3d<f32> Box;
+	};
+
+} // end namespace gui
+} // end namespace irr
+
+#endif // __C_GUI_TTTEXTSCENENODE_H_INCLUDED__